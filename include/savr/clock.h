@@ -22,6 +22,23 @@
 #ifndef _savr_clock_h_included_
 #define _savr_clock_h_included_
 
+/**
+ * @file clock.h
+ *
+ * Millisecond system clock and software timers
+ *
+ * The clock counts ticks from a hardware timer interrupt. On top of it,
+ * any number of one-shot or periodic Timers can be armed. Timers are kept
+ * in a hashed timer wheel, so arming and cancelling are O(1). Each tick
+ * only looks at the timers in one wheel slot.
+ *
+ * Build-time settings:
+ *   -DCLOCK_TIMER_SLOTS=n  Wheel slots (power of two, default 8). More slots
+ *                          cost two bytes each and mean fewer timers are
+ *                          looked at per tick.
+ *   -DCLOCK_NO_TIMERS      Remove the timer service from the tick ISR
+ */
+
 #include <stddef.h>
 #include <stdint.h>
 
@@ -45,6 +62,14 @@ constexpr uint32_t OCR_VALUE = F_CPU / CLOCK_SCALE / TICKS_PER_SEC;
 // Ensure our result didn't get rounded somewhere
 static_assert((OCR_VALUE * CLOCK_SCALE * TICKS_PER_SEC) == F_CPU,
               "CPU frequency does not produce an integer counter");
+static_assert(OCR_VALUE <= 256, "Tick period does not fit the 8-bit timer");
+
+// Sub-tick resolution: one timer count, in microseconds
+constexpr uint32_t US_PER_TICK = 1000000 / TICKS_PER_SEC;
+constexpr uint32_t US_PER_COUNT = US_PER_TICK / OCR_VALUE;
+
+static_assert(US_PER_COUNT * OCR_VALUE == US_PER_TICK,
+              "CPU frequency does not produce an integer microsecond count");
 
 /**
  * Initialize the clock subsystem
@@ -68,6 +93,162 @@ uint32_t ticks();
  */
 uint8_t ticks_byte();
 
+/**
+ * Get the low 16 bits of the number of ticks elapsed
+ *
+ * Like ticks_byte(), there is no interrupt management, so the two bytes
+ * can tear if the tick interrupt lands between them. Call it with
+ * interrupts disabled (or from an ISR) for a consistent value.
+ *
+ * @return Low 16 bits of the system ticks (milliseconds)
+ */
+uint16_t ticks_word();
+
+/**
+ * Get the time since clock::init() in microseconds
+ *
+ * Combines the tick count with the hardware timer, so the resolution is
+ * US_PER_COUNT (4us at 16 MHz). Wraps after about 71 minutes; compare
+ * timestamps by unsigned subtraction.
+ *
+ * @return Microseconds elapsed
+ */
+uint32_t micros();
+
+/**
+ * Get the time since clock::init() in CPU cycles
+ *
+ * The resolution is CLOCK_SCALE cycles, the timer prescaler. Wraps after
+ * 2^32 cycles (about 268 seconds at 16 MHz).
+ *
+ * @return CPU cycles elapsed
+ */
+uint32_t cycles();
+
+/**
+ * Put the CPU to sleep until there is something to do
+ *
+ * Sleeps until the next software timer is due, or until any interrupt
+ * (received data, for instance). With timers armed far apart, the tick
+ * interrupt is held off for the whole sleep instead of waking the CPU every
+ * millisecond. Returns at once if a deferred timer is waiting to run.
+ *
+ * Call it at the end of the main loop:
+ *
+ *     while (true) {
+ *         clock::run_timers();
+ *         term::work();
+ *         clock::idle();
+ *     }
+ *
+ * ISR timers that came due during the sleep are run from here, with
+ * interrupts disabled, before it returns.
+ *
+ * Work flagged by an ISR just before the sleep would be missed. To close
+ * that gap, pass a function that reports pending work. It is called with
+ * interrupts disabled, right before sleeping, and the sleep is skipped if it
+ * returns true.
+ *
+ * @param busy Function reporting work to do, or nullptr
+ * @return Number of ticks slept through without the tick interrupt
+ */
+uint16_t idle(bool (*busy)() = nullptr);
+
+
+#ifndef CLOCK_NO_TIMERS
+
+/**
+ * Timer expiry callback
+ *
+ * @param arg The argument given to the Timer
+ */
+typedef void (*TimerCallback)(void *arg);
+
+/**
+ * Timer flags
+ */
+constexpr uint8_t TIMER_IN_ISR = 0x01;  ///< Run the callback in the tick ISR
+constexpr uint8_t TIMER_ARMED = 0x40;   ///< Internal: in the wheel
+constexpr uint8_t TIMER_PENDING = 0x80; ///< Internal: waiting in run_timers()
+
+/**
+ * A software timer
+ *
+ * The storage is owned by the caller and must outlive the timer's use,
+ * usually by being static. The fields are managed by the clock; only set them
+ * through the constructor.
+ *
+ * By default the callback is deferred: expiry only queues the timer, and the
+ * callback is run by the next call to run_timers(). With TIMER_IN_ISR, the
+ * callback runs in the tick interrupt instead. It must then be short, but it
+ * may start or stop any timer, including its own.
+ */
+struct Timer {
+    Timer *next;            ///< Next in the wheel slot
+    Timer **pprev;          ///< Link that points at this timer
+    Timer *pending;         ///< Next in the deferred queue
+    uint32_t expires;       ///< Tick at which it fires
+    uint32_t period;        ///< Reload interval, 0 for one-shot
+    TimerCallback callback;
+    void *arg;
+    volatile uint8_t flags;
+
+    constexpr Timer(TimerCallback cb, void *cb_arg = nullptr,
+                    uint8_t timer_flags = 0) noexcept :
+        next(nullptr), pprev(nullptr), pending(nullptr), expires(0),
+        period(0), callback(cb), arg(cb_arg), flags(timer_flags) {
+    }
+};
+
+/**
+ * Arm a timer
+ *
+ * Re-arming an active timer moves its deadline. A periodic timer keeps its
+ * phase: each expiry is exactly period ticks after the last, however late
+ * its callback runs.
+ *
+ * @param timer The timer to arm
+ * @param delay Ticks until the first expiry (0 is treated as 1)
+ * @param period Ticks between later expiries, or 0 for a one-shot timer
+ */
+void
+start_timer(Timer &timer, uint32_t delay, uint32_t period = 0);
+
+/**
+ * Cancel a timer
+ *
+ * Also removes it from the deferred queue, so its callback will not run
+ * after this returns (unless it is running right now, from an ISR).
+ *
+ * @param timer The timer to cancel
+ */
+void
+stop_timer(Timer &timer);
+
+/**
+ * Check if a timer is armed or waiting to run
+ *
+ * @param timer The timer to check
+ * @return true if the callback has yet to run
+ */
+inline bool
+timer_active(const Timer &timer) {
+    return timer.flags & (TIMER_ARMED | TIMER_PENDING);
+}
+
+/**
+ * Run the callbacks of expired, deferred timers
+ *
+ * Call this from the main loop. Callbacks run with interrupts enabled, in the
+ * order the timers expired.
+ *
+ * @return Number of callbacks run
+ */
+uint8_t
+run_timers();
+
+#endif
+
 }
 }
 
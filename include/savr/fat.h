@@ -0,0 +1,189 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_fat_h_included_
+#define _savr_fat_h_included_
+
+/**
+ * @file fat.h
+ *
+ * FAT16/FAT32 files on the SD card
+ *
+ * A small filesystem layer over the sd block cache, enough to write files a
+ * PC can read straight off the card, and to read files it put there. One
+ * volume is mounted at a time: the first FAT partition in the MBR, or a card
+ * formatted without a partition table.
+ *
+ * Paths are 8.3 names separated by '/', relative to the root directory, and
+ * are matched without regard to case (e.g. "LOGS/DATA.CSV"). Long file names
+ * are skipped over, and not created. Files can be created in existing
+ * directories; directories can not be created.
+ *
+ * Each open File remembers its directory entry and where it is in its
+ * cluster chain, so sequential reads and appends follow the chain one link
+ * at a time and never re-walk it from the start. The FAT and directory
+ * blocks they touch go through the sd cache (see sd::cache_block()); three
+ * or more cache slots (-DSD_CACHE_SLOTS=3) keep the FAT block from being
+ * pushed out by file data.
+ *
+ * Changes reach the card on sync() or close(). Timestamps are not kept.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace savr {
+namespace fat {
+
+//! Result of a filesystem call
+typedef enum {
+    OK = 0,
+    ERR_IO,         ///< The card failed a transfer
+    ERR_NO_FS,      ///< No FAT16/FAT32 volume, or not mounted
+    ERR_NOT_FOUND,  ///< No such file or directory
+    ERR_BAD_NAME,   ///< Not a valid 8.3 path
+    ERR_FULL,       ///< No free cluster, or no room in the directory
+    ERR_DENIED,     ///< Not open for this, or a directory
+    ERR_CORRUPT,    ///< A cluster chain points outside the volume
+} Result;
+
+//! open() modes, or'd together
+typedef enum {
+    READ    = 0x01,     ///< Allow read()
+    WRITE   = 0x02,     ///< Allow write()
+    CREATE  = 0x04,     ///< Create the file if it does not exist
+    APPEND  = 0x08,     ///< Every write() goes to the end of the file
+} Mode;
+
+//! An open file
+typedef struct {
+    uint32_t size;          ///< File size in bytes
+    uint32_t pos;           ///< Read/write position
+    uint32_t first;         ///< First cluster, 0 while empty
+    uint32_t cluster;       ///< Cluster holding pos, 0 if not found yet
+    uint32_t cluster_pos;   ///< File position of the start of cluster
+    uint32_t dir_block;     ///< Block holding the directory entry
+    uint8_t dir_index;      ///< Entry within dir_block
+    uint8_t mode;           ///< Mode bits, 0 when closed
+    bool dirty;             ///< Directory entry needs updating
+} File;
+
+
+/**
+ * Mount the volume on the card.
+ *
+ * The card must already be set up with sd::init(). Drops anything in the sd
+ * cache, so files open on an earlier mount must be closed first.
+ *
+ * @return OK, ERR_IO or ERR_NO_FS
+ */
+Result
+mount();
+
+
+/**
+ * Open a file.
+ *
+ * @param file  the file to open
+ * @param path  the 8.3 path, from the root directory
+ * @param mode  Mode bits
+ *
+ * @return OK, or why not
+ */
+Result
+open(File &file, const char *path, uint8_t mode);
+
+
+/**
+ * Read from a file at its position.
+ *
+ * Stops short at the end of the file.
+ *
+ * @param file      an open file
+ * @param buf       destination
+ * @param length    bytes wanted
+ * @param done      set to the number of bytes read
+ *
+ * @return OK, or why not
+ */
+Result
+read(File &file, void *buf, size_t length, size_t &done);
+
+
+/**
+ * Write to a file at its position (or its end, if opened with APPEND).
+ *
+ * Clusters are added as the file grows. Only short if the card is full or
+ * fails.
+ *
+ * @param file      a file open with WRITE
+ * @param buf       source
+ * @param length    bytes to write
+ * @param done      set to the number of bytes written
+ *
+ * @return OK, or why not
+ */
+Result
+write(File &file, const void *buf, size_t length, size_t &done);
+
+
+/**
+ * Move a file's position.
+ *
+ * Positions past the end of the file are clamped to it; files are not
+ * extended by seeking.
+ *
+ * @param file  an open file
+ * @param pos   the new position, from the start of the file
+ *
+ * @return OK, or why not
+ */
+Result
+seek(File &file, uint32_t pos);
+
+
+/**
+ * Write a file's changes to the card.
+ *
+ * Updates the directory entry and flushes the sd cache.
+ *
+ * @param file  an open file
+ *
+ * @return OK, or why not
+ */
+Result
+sync(File &file);
+
+
+/**
+ * Sync and close a file.
+ *
+ * @param file  an open file
+ *
+ * @return OK, or why not
+ */
+Result
+close(File &file);
+
+}
+}
+
+#endif /* _savr_fat_h_included_ */
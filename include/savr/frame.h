@@ -0,0 +1,165 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_frame_h_included_
+#define _savr_frame_h_included_
+
+/**
+ * @file frame.h
+ *
+ * Framed binary transport over the SCI
+ *
+ * Each frame is the payload followed by a CRC-16 (CCITT-FALSE, big-endian),
+ * COBS encoded, and terminated by a 0x00 delimiter. A delimiter is also sent
+ * ahead of every frame so a receiver resynchronizes after line noise.
+ *
+ * Received bytes are decoded, and their CRC updated, in the receive ISR.
+ * Completed frames are handed to the application through a small queue of
+ * frame slots, each marked good or bad as it is closed.
+ *
+ * Build-time settings:
+ *   -DFRAME_MAX_PAYLOAD=n  Largest payload, in bytes (default 64, max 253)
+ *   -DFRAME_SLOTS=n        Completed-frame queue depth (power of two, default 2)
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <savr/sci.h>
+
+#if !defined(SAVR_NO_SCI)
+
+#ifndef FRAME_MAX_PAYLOAD
+#define FRAME_MAX_PAYLOAD 64
+#endif
+
+#ifndef FRAME_SLOTS
+#define FRAME_SLOTS 2
+#endif
+
+namespace savr {
+namespace frame {
+
+constexpr size_t MAX_PAYLOAD = FRAME_MAX_PAYLOAD;
+
+static_assert(MAX_PAYLOAD + 2 <= 255, "Frame payload too large");
+
+/**
+ * Receive error counters
+ */
+typedef struct {
+    uint16_t frames;        ///< Frames received, including CRC errors
+    uint16_t crc_errors;    ///< Frames dropped for a bad CRC
+    uint16_t bad_frames;    ///< Frames dropped for bad encoding or length
+    uint16_t overflows;     ///< Frames dropped because every slot was full
+} Stats;
+
+/**
+ * Frame decoder, installed as the USART receive hook by init()
+ *
+ * @param data received byte
+ */
+void
+rx_byte(uint8_t data);
+
+/**
+ * Bind the framing layer to the output function of a USART
+ *
+ * Use init() instead.
+ *
+ * @param write Non-blocking block write, such as Usart<N>::write
+ */
+void
+attach(size_t (*write)(const void *, size_t));
+
+/**
+ * Initialize the framing layer on USART N
+ *
+ * The USART must already be initialized. From here on, every byte it
+ * receives is consumed by the frame decoder.
+ */
+template<uint8_t N = 0>
+inline void
+init() {
+    attach(sci::Usart<N>::write);
+    sci::Usart<N>::set_rx_hook(rx_byte);
+}
+
+/**
+ * Send a frame
+ *
+ * Blocks until the whole frame is queued for transmission. With interrupts
+ * disabled (or from an ISR) the transmit buffer can't drain, so it gives up
+ * once the buffer is full. The receiver drops the partial frame.
+ *
+ * May be called from an ISR, but not while the ISR has interrupted another
+ * send(); that call fails without touching the frame in progress.
+ *
+ * @param payload pointer to the payload
+ * @param length payload length, up to MAX_PAYLOAD
+ * @return true if sent, false if the payload is too large, the frame didn't
+ *         fit with interrupts disabled, or another send() was in progress
+ */
+bool
+send(const void *payload, size_t length);
+
+/**
+ * Get the oldest received frame without copying it
+ *
+ * Frames with a bad CRC are dropped (and counted) along the way. The frame
+ * stays valid until release() is called.
+ *
+ * @param[out] length payload length
+ * @return pointer to the payload, or nullptr if no frame is waiting
+ */
+const uint8_t *
+peek(size_t &length);
+
+/**
+ * Release the frame returned by peek(), freeing its slot for the ISR
+ */
+void
+release();
+
+/**
+ * Copy out and release the oldest received frame
+ *
+ * @param dst destination buffer
+ * @param length size of dst; longer payloads are truncated
+ * @return payload length, or 0 if no frame is waiting
+ */
+size_t
+receive(void *dst, size_t length);
+
+/**
+ * Get a copy of the receive counters
+ *
+ * @param[out] stats destination for the counters
+ */
+void
+get_stats(Stats &stats);
+
+}
+}
+
+#endif
+
+#endif /* _savr_frame_h_included_ */
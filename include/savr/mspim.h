@@ -0,0 +1,159 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_mspim_h_included_
+#define _savr_mspim_h_included_
+
+/**
+ * @file mspim.h
+ *
+ * SPI master on a USART (Master SPI Mode, MSPIM)
+ *
+ * The USARTs of the ATmega48/88/168/328 and 164/324/644/1284 families can
+ * run as SPI masters. TXD is MOSI, RXD is MISO and XCK is SCK. Unlike the
+ * SPI peripheral, the transmitter is double buffered, so the next byte can
+ * be queued while one shifts and blocks go out with no gap between bytes.
+ * This gives a second SPI bus, e.g. an SD card on USART1 and a radio on
+ * the SPI peripheral, each at its own full rate.
+ *
+ * The block API matches spi.h. A USART used as an SPI master is not
+ * available to sci.h; on the ATmega328P that means losing the console.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <savr/gpio.h>
+#include <savr/spi.h>
+
+namespace savr {
+namespace mspim {
+
+/**
+ * A device on an MSPIM bus
+ *
+ * Like spi::Device: the slave select pin and the register values for the
+ * device's clock and mode.
+ */
+struct Device {
+    gpio::Pin ss;       ///< Slave select, active low
+    uint16_t ubrr;      ///< Baud register while this device is selected
+    uint8_t ctrlc;      ///< UCSRnC (mode bits) while this device is selected
+
+    //! An unconfigured device; assign a configured one before use
+    constexpr Device() : ss(gpio::B0), ubrr(0), ctrlc(0) {}
+
+    /**
+     * Set up a device, and drive its SS pin high (deselected)
+     *
+     * @param ss        Slave select pin
+     * @param max_freq  Fastest SPI clock the device takes. Any clock of
+     *                  F_CPU / 2n is possible; the closest at or below
+     *                  this is used.
+     * @param mode      Clock polarity and phase
+     */
+    Device(gpio::Pin ss, uint32_t max_freq, spi::Mode mode = spi::MODE_0);
+
+    /**
+     * Change the device's clock
+     *
+     * @param max_freq  Fastest SPI clock the device takes
+     */
+    void
+    set_clock(uint32_t max_freq);
+};
+
+
+/**
+ * SPI master on USART N
+ *
+ * @tparam N USART number, as named in the datasheet
+ *
+ * Only the USARTs present on the target may be used.
+ */
+template<uint8_t N>
+class Bus {
+public:
+
+    /**
+     * Put the USART in MSPIM mode and set up XCK
+     *
+     * @param freq  SPI clock (rounded down), for use without a Device
+     * @param mode  Clock polarity and phase
+     */
+    static void
+    init(uint32_t freq, spi::Mode mode = spi::MODE_0);
+
+    /**
+     * Configure the bus for a device and select it
+     */
+    static void
+    begin(const Device &device);
+
+    /**
+     * Deselect a device
+     */
+    static void
+    end(const Device &device);
+
+    /**
+     * Tx/Rx a byte
+     *
+     * @param input the byte to send
+     * @return the byte read
+     */
+    static uint8_t
+    trx_byte(uint8_t input);
+
+    /**
+     * Write a block of data; received bytes are discarded
+     *
+     * @param input a pointer to the source data
+     * @param length the size of the source data
+     */
+    static void
+    write_block(const uint8_t *input, size_t length);
+
+    /**
+     * Read a block of data
+     *
+     * @param output a pointer to the destination buffer
+     * @param length the number of bytes to read
+     * @param filler a byte to send continuously while reading
+     */
+    static void
+    read_block(uint8_t *output, size_t length, uint8_t filler);
+
+    /**
+     * Send and receive a block of data
+     *
+     * @param input a pointer to the source data
+     * @param output a pointer to the destination buffer (may be input)
+     * @param length the number of bytes
+     */
+    static void
+    trx_block(const uint8_t *input, uint8_t *output, size_t length);
+};
+
+}
+}
+
+#endif /* _savr_mspim_h_included_ */
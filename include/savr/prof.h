@@ -0,0 +1,187 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_prof_h_included_
+#define _savr_prof_h_included_
+
+/**
+ * @file prof.h
+ *
+ * Cycle-counting profiling probes
+ *
+ * Put SAVR_PROFILE("name") at the top of a block to time it. Each probe
+ * keeps a call count, min, average and max cycles, and a log2 histogram of
+ * its durations. The table is printed (and cleared) by command(), which
+ * fits straight into a terminal command list.
+ *
+ * Example:
+ *   uint8_t
+ *   spi::trx_byte(uint8_t input) {
+ *       SAVR_PROFILE("spi::trx_byte");
+ *       ...
+ *   }
+ *
+ * Probes read Timer1, which init() starts free-running at the CPU clock, so
+ * Timer1 can not be used for anything else while profiling. Durations
+ * longer than 65535 cycles wrap.
+ *
+ * Build-time settings:
+ *   -DSAVR_PROFILE_ENABLE  Turn the probes on. Without it SAVR_PROFILE()
+ *                          compiles to nothing, and init() and command()
+ *                          do nothing. Use the same setting for the library
+ *                          and the application.
+ */
+
+#include <stdint.h>
+
+#ifdef SAVR_PROFILE_ENABLE
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include <savr/cpp_pgmspace.h>
+#endif
+
+namespace savr {
+namespace prof {
+
+//! Histogram buckets. Bucket n counts durations below 2^n cycles (and at
+//! least 2^(n-1)); the last one counts everything longer.
+constexpr uint8_t BUCKETS = 16;
+
+
+/**
+ * Start Timer1 and calibrate out the probe overhead
+ */
+void
+init();
+
+
+/**
+ * Clear every probe
+ */
+void
+reset();
+
+
+/**
+ * Terminal command: print the probe table, then clear it
+ *
+ * @param args  Unused
+ * @return 0
+ */
+uint8_t
+command(char *args);
+
+
+#ifdef SAVR_PROFILE_ENABLE
+
+/**
+ * One probe site. Use SAVR_PROFILE() rather than creating these directly.
+ */
+struct Probe {
+    Probe *next;                ///< Next probe in the table
+    const char *name;           ///< Name, in program space
+    uint32_t count;             ///< Times the probe ran
+    uint32_t total;             ///< Cycles over all runs
+    uint16_t min;               ///< Shortest run, cycles
+    uint16_t max;               ///< Longest run, cycles
+    uint16_t hist[BUCKETS];     ///< log2 histogram (saturating)
+    bool linked;                ///< Added to the table on first run
+
+    constexpr Probe(const char *name) :
+        next(nullptr), name(name), count(0), total(0),
+        min(UINT16_MAX), max(0), hist(), linked(false) {}
+};
+
+
+/**
+ * Read the profiling timer
+ */
+static inline uint16_t
+now() {
+    uint16_t ret;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ret = TCNT1;
+    }
+    return ret;
+}
+
+
+/**
+ * Add one run to a probe
+ *
+ * @param probe The probe
+ * @param start now() at the start of the run
+ */
+void
+record(Probe &probe, uint16_t start);
+
+
+/**
+ * Times its own lifetime into a Probe
+ */
+class Scope {
+public:
+    Scope(Probe &probe) : _probe(probe), _start(now()) {}
+    ~Scope() { record(_probe, _start); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    Probe &_probe;
+    uint16_t _start;
+};
+
+#endif
+
+}
+}
+
+
+#ifdef SAVR_PROFILE_ENABLE
+
+#define _SAVR_PROF_CAT2(a, b) a ## b
+#define _SAVR_PROF_CAT(a, b) _SAVR_PROF_CAT2(a, b)
+
+/**
+ * Time the rest of the enclosing block under the given name
+ *
+ * The probe is a function-local static with a constant initializer, so
+ * there is no first-call guard; it joins the table the first time it runs.
+ */
+#define SAVR_PROFILE(name)                                                  \
+    static const char CPP_PROGMEM                                           \
+        _SAVR_PROF_CAT(_prof_name_, __LINE__)[] = (name);                   \
+    static ::savr::prof::Probe                                              \
+        _SAVR_PROF_CAT(_prof_probe_, __LINE__)(                             \
+            _SAVR_PROF_CAT(_prof_name_, __LINE__));                         \
+    ::savr::prof::Scope                                                     \
+        _SAVR_PROF_CAT(_prof_scope_, __LINE__)(                             \
+            _SAVR_PROF_CAT(_prof_probe_, __LINE__))
+
+#else
+
+#define SAVR_PROFILE(name) do {} while (0)
+
+#endif
+
+#endif /* _savr_prof_h_included_ */
@@ -0,0 +1,227 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_pt_h_included_
+#define _savr_pt_h_included_
+
+/**
+ * @file pt.h
+ *
+ * Protothreads: stackless coroutines
+ *
+ * A protothread is a function that can wait without blocking. Each time it
+ * is called it resumes where it last waited and runs until it must wait
+ * again, then returns. The only RAM it needs is a Pt; there is no stack per
+ * thread. This is the same line-number continuation technique as Adam
+ * Dunkels' protothreads, with the caveats that come with it:
+ *
+ *   - Locals are not kept across a wait. Keep state in statics or in a
+ *     struct alongside the Pt.
+ *   - A switch statement can't contain a wait.
+ *   - Only the protothread function itself may wait. Waiting on a nested
+ *     operation is done with PT_WAIT_THREAD on a child protothread.
+ *
+ * Example, with the task scheduler (task.h) driving it:
+ *
+ *     static pt::Pt blink_pt;
+ *
+ *     static pt::State
+ *     blink_thread(pt::Pt *pt) {
+ *         PT_BEGIN(pt);
+ *         for (;;) {
+ *             PT_WAIT_UNTIL_TIMEOUT(pt, button_pressed(), 500);
+ *             gpio::toggle<LED>();
+ *         }
+ *         PT_END(pt);
+ *     }
+ *
+ *     static void
+ *     blink_task_fn(void *) {
+ *         if (PT_SCHEDULE(blink_thread(&blink_pt))) {
+ *             task::sleep(*task::current(), 1);
+ *         }
+ *     }
+ *
+ * Timeouts use clock::ticks(), so the clock must be running.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <savr/clock.h>
+
+namespace savr {
+namespace pt {
+
+/**
+ * Protothread return values
+ */
+typedef enum {
+    WAITING = 0,    ///< Blocked on a condition
+    YIELDED = 1,    ///< Gave up the CPU, ready to continue
+    EXITED = 2,     ///< Stopped early with PT_EXIT
+    ENDED = 3,      ///< Ran to PT_END
+} State;
+
+/**
+ * Protothread control block
+ */
+struct Pt {
+    uint16_t lc;            ///< Where to resume (a source line, 0 to start)
+    bool timed_out;         ///< PT_WAIT_UNTIL_TIMEOUT ran out of time
+    uint32_t deadline;      ///< Tick at which a timed wait gives up
+
+    constexpr Pt() noexcept : lc(0), timed_out(false), deadline(0) {
+    }
+};
+
+/**
+ * Check if a deadline has passed
+ */
+inline bool
+expired(uint32_t deadline) {
+    return static_cast<int32_t>(clock::ticks() - deadline) >= 0;
+}
+
+}
+}
+
+/**
+ * Restart a protothread from the top
+ */
+#define PT_INIT(self)             do { (self)->lc = 0; } while (0)
+
+/**
+ * Start of the protothread body
+ */
+#define PT_BEGIN(self)            { bool _pt_yield = true; (void)_pt_yield; \
+                                  switch ((self)->lc) { case 0:
+
+/**
+ * End of the protothread body
+ */
+#define PT_END(self)              } (self)->lc = 0; return savr::pt::ENDED; }
+
+/**
+ * Save the resume point; internal
+ */
+#define _PT_SET(self)             (self)->lc = __LINE__; [[fallthrough]];   \
+                                  case __LINE__:
+
+/**
+ * Wait until a condition is true
+ */
+#define PT_WAIT_UNTIL(self, cond)                                           \
+    do {                                                                    \
+        _PT_SET(self)                                                       \
+        if (!(cond)) {                                                      \
+            return savr::pt::WAITING;                                       \
+        }                                                                   \
+    } while (0)
+
+/**
+ * Wait while a condition is true
+ */
+#define PT_WAIT_WHILE(self, cond) PT_WAIT_UNTIL((self), !(cond))
+
+/**
+ * Wait until a condition is true, or a number of ticks (milliseconds) pass
+ *
+ * Afterwards, PT_TIMED_OUT(self) tells which happened.
+ */
+#define PT_WAIT_UNTIL_TIMEOUT(self, cond, ms)                               \
+    do {                                                                    \
+        (self)->deadline = savr::clock::ticks() + (ms);                     \
+        _PT_SET(self)                                                       \
+        if (cond) {                                                         \
+            (self)->timed_out = false;                                      \
+        } else if (savr::pt::expired((self)->deadline)) {                   \
+            (self)->timed_out = true;                                       \
+        } else {                                                            \
+            return savr::pt::WAITING;                                       \
+        }                                                                   \
+    } while (0)
+
+/**
+ * True if the last PT_WAIT_UNTIL_TIMEOUT ran out of time
+ */
+#define PT_TIMED_OUT(self)        ((self)->timed_out)
+
+/**
+ * Wait for a number of ticks (milliseconds)
+ */
+#define PT_DELAY(self, ms)        PT_WAIT_UNTIL_TIMEOUT((self), false, (ms))
+
+/**
+ * Give up the CPU once, continuing on the next call
+ */
+#define PT_YIELD(self)                                                      \
+    do {                                                                    \
+        _pt_yield = false;                                                  \
+        _PT_SET(self)                                                       \
+        if (!_pt_yield) {                                                   \
+            return savr::pt::YIELDED;                                       \
+        }                                                                   \
+    } while (0)
+
+/**
+ * Run a child protothread until it finishes
+ *
+ * @param thread A call to the child, such as sd::write_block_pt(&child, ...)
+ */
+#define PT_WAIT_THREAD(self, thread) PT_WAIT_WHILE((self), PT_SCHEDULE(thread))
+
+/**
+ * Start a child protothread and wait for it to finish
+ */
+#define PT_SPAWN(self, child, thread)                                       \
+    do {                                                                    \
+        PT_INIT(child);                                                     \
+        PT_WAIT_THREAD((self), (thread));                                   \
+    } while (0)
+
+/**
+ * Stop the protothread now, restarting it on the next call
+ */
+#define PT_EXIT(self)                                                       \
+    do {                                                                    \
+        PT_INIT(self);                                                      \
+        return savr::pt::EXITED;                                            \
+    } while (0)
+
+/**
+ * End the protothread now, as if it had reached PT_END
+ *
+ * For an early finish that callers waiting on pt::ENDED should see, such as
+ * a failure reported through an out-parameter.
+ */
+#define PT_FINISH(self)                                                     \
+    do {                                                                    \
+        PT_INIT(self);                                                      \
+        return savr::pt::ENDED;                                             \
+    } while (0)
+
+/**
+ * Run a protothread once; true while it has not finished
+ */
+#define PT_SCHEDULE(f)          ((f) < savr::pt::EXITED)
+
+#endif /* _savr_pt_h_included_ */
@@ -22,7 +22,12 @@
 /**
  * @file queue.h
  *
- * Small (<256 items) circular queue functionality of any type.
+ * Circular queue functionality of any type.
+ *
+ * Queue is safe to use from any number of contexts, at the cost of masking
+ * interrupts for every operation. SpscQueue is a lock-free alternative for
+ * the common case of exactly one producer and one consumer, such as the main
+ * loop feeding an ISR.
  */
 
 #include <stdint.h>
@@ -30,23 +35,74 @@
 
 #include <util/atomic.h>
 
+#include <savr/utils.h>
+
 namespace savr {
 
-template<typename T, uint8_t MAX_SIZE>
+namespace detail {
+
+/**
+ * Smallest index type able to count to a queue's capacity
+ */
+template<bool WIDE>
+struct QueueIndex {
+    typedef uint8_t type;
+};
+
+template<>
+struct QueueIndex<true> {
+    typedef uint16_t type;
+};
+
+}
+
+
+/**
+ * Circular queue, safe for any number of producers and consumers
+ *
+ * Every operation runs with interrupts masked. The bulk operations move a
+ * whole run of elements under a single critical section, and
+ * contiguous_read_span() lets a consumer work on queued data in place.
+ *
+ * Capacities up to 255 use byte-wide indices; larger ones (up to 65535) use
+ * 16-bit indices. Power-of-two capacities wrap with a mask instead of a
+ * compare.
+ */
+template<typename T, size_t MAX_SIZE>
 class Queue {
 
-private:
-    T _data[MAX_SIZE];        ///< Queue data
-    uint8_t _top;                   ///< Index to top
-    uint8_t _bottom;                ///< Index to bottom
-    uint8_t _size;                  ///< Current size of the queue
+    static_assert(MAX_SIZE != 0, "Size must be non-zero");
+    static_assert(MAX_SIZE <= 0xFFFF, "Size must be 65535 or less");
 
 public:
+    //! Index and count type, sized from the capacity
+    typedef typename detail::QueueIndex<(MAX_SIZE > 0xFF)>::type size_type;
+
+private:
+    static constexpr bool POW2 = (MAX_SIZE & (MAX_SIZE - 1)) == 0;
+    static constexpr size_type MASK = static_cast<size_type>(MAX_SIZE - 1);
+
+    T _data[MAX_SIZE];              ///< Queue data
+    size_type _top;                 ///< Index to top
+    size_type _bottom;              ///< Index to bottom
+    size_type _size;                ///< Current size of the queue
 
     /**
-     * Allocate a queue of qsize bytes on the heap
-     * @param qsize     Size of the desired queue, in bytes.
+     * Move an index forward by count, wrapping at MAX_SIZE
      */
+    static FORCE_INLINE size_type
+    advance(size_type index, size_type count) {
+        if (POW2) {
+            return static_cast<size_type>(index + count) & MASK;
+        }
+        // Compare against the room left so the sum can never overflow
+        size_type room = MAX_SIZE - index;
+        if (count >= room) return count - room;
+        return index + count;
+    }
+
+public:
+
     Queue() noexcept :
         _top(0), _bottom(0), _size(0) {
     }
@@ -59,15 +115,15 @@ public:
      *
      * @param input the byte to place on the Queue
      *
-     * @return 1 if successful, 0 otherwise
+     * @return 0 if successful, 1 otherwise
      */
     uint8_t
     enq(T input) {
         ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
             if (_size == MAX_SIZE) return 1;
 
-            _data[_bottom++] = input;
-            if (_bottom >= MAX_SIZE) _bottom = 0;
+            _data[_bottom] = input;
+            _bottom = advance(_bottom, 1);
             _size++;
         }
         return 0;
@@ -81,21 +137,151 @@ public:
      *
      * @param target a pointer to a byte to place the read value
      *
-     * @return 1 if successful, 0 otherwise
+     * @return 0 if successful, 1 otherwise
      */
     uint8_t
     deq(T *target) {
         ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
             if (_size == 0) return 1;
 
-            *target = _data[_top++];
-            if (_top >= MAX_SIZE) _top = 0;
+            *target = _data[_top];
+            _top = advance(_top, 1);
             _size--;
         }
         return 0;
     }
 
 
+    /**
+     * Read an element without removing it
+     *
+     * Non-blocking. Will return error if there is no such element.
+     *
+     * @param target a pointer to place the read value
+     * @param offset position from the top of the queue, 0 being the oldest
+     *
+     * @return 0 if successful, 1 otherwise
+     */
+    uint8_t
+    peek(T *target, size_type offset = 0) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (offset >= _size) return 1;
+
+            *target = _data[advance(_top, offset)];
+        }
+        return 0;
+    }
+
+
+    /**
+     * Place a block of data on to the Queue
+     *
+     * Non-blocking. Copies as many elements as currently fit, in at most two
+     * contiguous runs, within one critical section.
+     *
+     * @param src pointer to the source elements
+     * @param length number of elements available at src
+     *
+     * @return Number of elements placed on the Queue
+     */
+    size_type
+    enq_n(const T *src, size_t length) {
+        size_type count;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            size_type space = MAX_SIZE - _size;
+            count = length < space ? static_cast<size_type>(length) : space;
+
+            size_type first = MAX_SIZE - _bottom;
+            if (first > count) first = count;
+
+            T *dst = &_data[_bottom];
+            for (size_type i = 0; i < first; ++i) {
+                dst[i] = src[i];
+            }
+            for (size_type i = first; i < count; ++i) {
+                _data[i - first] = src[i];
+            }
+
+            _bottom = advance(_bottom, count);
+            _size += count;
+        }
+        return count;
+    }
+
+
+    /**
+     * Grab a block of data from the Queue
+     *
+     * Non-blocking. Copies as many elements as are available, up to length,
+     * in at most two contiguous runs, within one critical section.
+     *
+     * @param dst pointer to the destination
+     * @param length maximum number of elements to copy to dst
+     *
+     * @return Number of elements read from the Queue
+     */
+    size_type
+    deq_n(T *dst, size_t length) {
+        size_type count;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            count = length < _size ? static_cast<size_type>(length) : _size;
+
+            size_type first = MAX_SIZE - _top;
+            if (first > count) first = count;
+
+            const T *src = &_data[_top];
+            for (size_type i = 0; i < first; ++i) {
+                dst[i] = src[i];
+            }
+            for (size_type i = first; i < count; ++i) {
+                dst[i] = _data[i - first];
+            }
+
+            _top = advance(_top, count);
+            _size -= count;
+        }
+        return count;
+    }
+
+
+    /**
+     * Get the longest run of queued elements that is contiguous in memory
+     *
+     * Non-blocking. Nothing is removed; call consume() once the run has been
+     * used. Producers never touch queued elements, so the run stays valid
+     * until then. Only one context may consume this way at a time.
+     *
+     * @param[out] span pointer to the oldest element
+     *
+     * @return Number of elements at span, 0 if the Queue is empty
+     */
+    size_type
+    contiguous_read_span(const T *&span) {
+        size_type count;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            span = &_data[_top];
+            count = MAX_SIZE - _top;
+            if (count > _size) count = _size;
+        }
+        return count;
+    }
+
+
+    /**
+     * Remove elements from the top of the Queue without reading them
+     *
+     * @param count number of elements to remove; clamped to the current size
+     */
+    void
+    consume(size_type count) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (count > _size) count = _size;
+            _top = advance(_top, count);
+            _size -= count;
+        }
+    }
+
+
     /**
      * Get the current number of elements in the queue.
      *
@@ -103,9 +289,162 @@ public:
      *
      * @return Number of elements in the queue
      */
-    uint8_t
+    size_type
     size() {
-        return _size;
+        size_type ret;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            ret = _size;
+        }
+        return ret;
+    }
+
+};
+
+
+/**
+ * Lock-free single-producer, single-consumer circular queue
+ *
+ * Exactly one context may call enq() and exactly one other context may call
+ * deq(). For instance, the main loop filling a transmit buffer that an ISR
+ * drains, or an ISR filling a receive buffer that the main loop drains.
+ *
+ * Each side owns one free-running index and only reads the other. Both
+ * indices are single bytes, so every access is naturally atomic on the AVR and
+ * interrupts are never masked.
+ *
+ * MAX_SIZE must be a power of two, no larger than 128.
+ */
+template<typename T, uint8_t MAX_SIZE>
+class SpscQueue {
+
+    static_assert(MAX_SIZE != 0 && (MAX_SIZE & (MAX_SIZE - 1)) == 0,
+                  "Size must be a power of two");
+    static_assert(MAX_SIZE <= 128, "Size must be 128 or less");
+
+private:
+    static constexpr uint8_t MASK = MAX_SIZE - 1;
+
+    T _data[MAX_SIZE];              ///< Queue data
+    volatile uint8_t _head;         ///< Write index, owned by the producer
+    volatile uint8_t _tail;         ///< Read index, owned by the consumer
+
+    // Data accesses are fenced with COMPILER_BARRIER() so they are never
+    // moved across the index update that hands them to the other side.
+
+public:
+
+    constexpr SpscQueue() noexcept :
+        _data(), _head(0), _tail(0) {
+    }
+
+
+    /**
+     * Place data on to the queue (producer side only)
+     *
+     * Non-blocking. Will return error if queue is full.
+     *
+     * @param input the element to place on the queue
+     *
+     * @return 0 if successful, 1 otherwise
+     */
+    uint8_t
+    enq(T input) {
+        uint8_t head = _head;
+        if (static_cast<uint8_t>(head - _tail) == MAX_SIZE) return 1;
+
+        _data[head & MASK] = input;
+        COMPILER_BARRIER();
+        _head = head + 1;
+        return 0;
+    }
+
+
+    /**
+     * Grab data from the queue (consumer side only)
+     *
+     * Non-blocking. Will return error if queue is empty.
+     *
+     * @param target a pointer to place the read value
+     *
+     * @return 0 if successful, 1 otherwise
+     */
+    uint8_t
+    deq(T *target) {
+        uint8_t tail = _tail;
+        if (tail == _head) return 1;
+
+        COMPILER_BARRIER();
+        *target = _data[tail & MASK];
+        COMPILER_BARRIER();
+        _tail = tail + 1;
+        return 0;
+    }
+
+
+    /**
+     * Place a block of data on to the queue (producer side only)
+     *
+     * Non-blocking. Copies as many elements as currently fit and publishes
+     * them all at once.
+     *
+     * @param src pointer to the source elements
+     * @param length number of elements available at src
+     *
+     * @return Number of elements placed on the queue
+     */
+    uint8_t
+    enq_n(const T *src, size_t length) {
+        uint8_t head = _head;
+        uint8_t space = MAX_SIZE - static_cast<uint8_t>(head - _tail);
+        uint8_t count = length < space ? static_cast<uint8_t>(length) : space;
+
+        for (uint8_t i = 0; i < count; ++i) {
+            _data[(head + i) & MASK] = src[i];
+        }
+        COMPILER_BARRIER();
+        _head = head + count;
+        return count;
+    }
+
+
+    /**
+     * Grab a block of data from the queue (consumer side only)
+     *
+     * Non-blocking. Copies as many elements as are available, up to length,
+     * and releases them all at once.
+     *
+     * @param dst pointer to the destination
+     * @param length maximum number of elements to copy to dst
+     *
+     * @return Number of elements read from the queue
+     */
+    uint8_t
+    deq_n(T *dst, size_t length) {
+        uint8_t tail = _tail;
+        uint8_t avail = static_cast<uint8_t>(_head - tail);
+        uint8_t count = length < avail ? static_cast<uint8_t>(length) : avail;
+
+        COMPILER_BARRIER();
+        for (uint8_t i = 0; i < count; ++i) {
+            dst[i] = _data[(tail + i) & MASK];
+        }
+        COMPILER_BARRIER();
+        _tail = tail + count;
+        return count;
+    }
+
+
+    /**
+     * Get the current number of elements in the queue.
+     *
+     * Non-blocking. May be called from either side. The result is only a
+     * snapshot; the other side may change it at any time.
+     *
+     * @return Number of elements in the queue
+     */
+    uint8_t
+    size() const {
+        return static_cast<uint8_t>(_head - _tail);
     }
 
 };
@@ -30,6 +30,7 @@
 #include <stddef.h>
 
 #include <savr/gpio.h>
+#include <savr/pt.h>
 #include <savr/rfm69_const.h>
 #include <savr/rfm69_settings.h>
 
@@ -78,6 +79,41 @@ rx_pdu(void *dst, size_t length);
 void
 tx_pdu(void *src, size_t length);
 
+/**
+ * Receive a packet data unit (PDU), as a protothread
+ *
+ * Same as rx_pdu(), but waits for the packet with PT_WAIT instead of
+ * spinning. Call until it returns pt::ENDED, with the same arguments each
+ * time; it also ends on a timeout, with received set to 0. See pt.h.
+ *
+ * @param[in] self: Protothread state
+ * @param[out] dst: Destination buffer
+ * @param[in] length: Maximum number of bytes to receive
+ * @param[in] timeout: Milliseconds to wait for a packet, 0 for no limit
+ * @param[out] received: Number of bytes in the packet, 0 on timeout
+ */
+pt::State
+rx_pdu_pt(pt::Pt *self, void *dst, size_t length, uint16_t timeout,
+          size_t &received);
+
+/**
+ * Send a packet data unit (PDU), as a protothread
+ *
+ * Same as tx_pdu(), but waits for the radio with PT_WAIT instead of
+ * spinning. Call until it returns pt::ENDED, with the same arguments each
+ * time. See pt.h.
+ *
+ * @param[in] self: Protothread state
+ * @param[in] src: Source buffer
+ * @param[in] length: Number of bytes to send (from src)
+ * @param[in] timeout: Milliseconds to wait for the packet to go out, 0 for
+ *                     no limit
+ * @param[out] sent: true if sent, false on timeout
+ */
+pt::State
+tx_pdu_pt(pt::Pt *self, void *src, size_t length, uint16_t timeout,
+          bool &sent);
+
 /**
  * Send a packet data unit (PDU) and retry
  *
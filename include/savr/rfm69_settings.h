@@ -46,6 +46,9 @@ namespace rfm69 {
 /// Slave select for SPI interface
 const gpio::Pin PIN_SS = gpio::B4;
 
+/// Fastest SPI clock the radio takes
+const uint32_t SPI_MAX_CLOCK = 10000000;
+
 /// Used for interrupts and quick status polling
 const gpio::Pin PIN_DIO0 = gpio::B2;
 
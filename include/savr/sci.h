@@ -32,7 +32,24 @@
  * read/write data over the serial line using printf and similar
  * calls.
  *
- * This is intended to be one-per-system as the 'debug console'.
+ * The free functions operate on USART0, intended to be one-per-system as the
+ * 'debug console'. Every USART on the target is also available through
+ * Usart<N>, each with its own buffers, interrupts, and FILE streams. For
+ * instance, Usart<1> on the ATmega644P/1284P.
+ *
+ * The transmit and receive buffer depths are set when the library is built,
+ * with -DSCI_TX_BUFFER_SIZE=n and -DSCI_RX_BUFFER_SIZE=n for USART0 and
+ * -DSCI1_TX_BUFFER_SIZE=n and -DSCI1_RX_BUFFER_SIZE=n for USART1. Each must be
+ * a power of two, no larger than 128. All default to 8 bytes.
+ *
+ * Binary data can bypass stdio with write() and read(), which move whole
+ * blocks in and out of the buffers.
+ *
+ * By default, stdout waits for room in a full transmit buffer. See Overflow
+ * for the alternatives.
+ *
+ * Each port keeps error and throughput counters, see Stats. Building with
+ * -DSCI_NO_STATS removes the counting from the ISRs.
  */
 
 #include <stdint.h>
@@ -40,6 +57,7 @@
 
 #include <stdio.h>
 
+#include <savr/clock.h>
 #include <savr/sci_defs.h>
 #include <savr/utils.h>
 
@@ -48,17 +66,353 @@
 namespace savr {
 namespace sci {
 
+/**
+ * Completion callback for send_async()
+ *
+ * This is called from the transmit ISR. It may start another asynchronous
+ * send.
+ */
+typedef void (*TxCallback)();
+
+/**
+ * Receive hook, see Usart::set_rx_hook()
+ *
+ * @param data The received byte
+ */
+typedef void (*RxHook)(uint8_t data);
+
+
+/**
+ * What stdout does when the transmit buffer is full
+ *
+ * Only the stdio stream is affected; write() never blocks.
+ */
+typedef enum {
+    OVERFLOW_BLOCK,         ///< Wait for room (default)
+    OVERFLOW_DROP_NEWEST,   ///< Discard the byte being written
+    OVERFLOW_DROP_OLDEST,   ///< Discard the oldest queued byte to make room
+    OVERFLOW_TIMEOUT,       ///< Wait for room, up to a deadline, then discard
+} Overflow;
+
+/**
+ * Source of time for OVERFLOW_TIMEOUT, such as clock::ticks
+ */
+typedef uint32_t (*TickSource)();
+
+
+/**
+ * Error and throughput counters for one USART
+ *
+ * The 16-bit counters wrap. Errored bytes are still delivered, as before;
+ * these only make them visible.
+ */
+typedef struct {
+    uint16_t rx_overrun;        ///< Data overruns flagged by the UART (DOR)
+    uint16_t rx_framing;        ///< Framing errors, a bad stop bit (FE)
+    uint16_t rx_parity;         ///< Parity errors (UPE)
+    uint16_t rx_dropped;        ///< Bytes lost to a full receive buffer
+    uint16_t tx_dropped;        ///< Bytes discarded by the overflow policy
+    uint32_t rx_bytes;          ///< Bytes received
+    uint32_t tx_bytes;          ///< Bytes handed to the UART
+    uint8_t  rx_high_water;     ///< Most bytes ever held in the receive buffer
+    uint8_t  tx_high_water;     ///< Most bytes ever held in the transmit buffer
+} Stats;
+
+
+/**
+ * Interrupt-driven USART
+ *
+ * @tparam N USART number, as named in the datasheet
+ *
+ * Only the ports present on the target may be used. All state is static, so
+ * there is exactly one of each.
+ */
+template<uint8_t N>
+class Usart {
+public:
+
+    /**
+     * Initialize the USART, its buffers, and its interrupts
+     *
+     * @param baud The desired baud rate
+     */
+    static void
+    init(uint32_t baud);
+
+    /**
+     * Bind stdin and stdout to this USART
+     */
+    static void
+    bind_stdio();
+
+    /**
+     * Get the output stream for this USART, for use with fprintf and the like
+     *
+     * @return Write-only stream
+     */
+    static FILE *
+    out();
+
+    /**
+     * Get the input stream for this USART, for use with fgetc and the like
+     *
+     * @return Read-only stream
+     */
+    static FILE *
+    in();
+
+    /**
+     * Get the number of bytes waiting in the buffer behind a stream
+     *
+     * @param stream out() or in()
+     * @return Number of bytes buffered
+     */
+    static size_t
+    size(FILE *stream);
+
+    /**
+     * Queue a block of data for transmission
+     *
+     * See sci::write()
+     */
+    static size_t
+    write(const void *src, size_t length);
+
+    /**
+     * Read a block of received data
+     *
+     * See sci::read()
+     */
+    static size_t
+    read(void *dst, size_t length);
+
+    /**
+     * Divert received bytes to a hook instead of the receive buffer
+     *
+     * The hook is run from the receive ISR for every byte, so it must be
+     * short. This is how protocol layers (see frame.h) parse data as it
+     * arrives. Pass nullptr to go back to the receive buffer.
+     *
+     * @param hook Function to receive each byte, or nullptr
+     */
+    static void
+    set_rx_hook(RxHook hook);
+
+    /**
+     * Set the stdout overflow policy
+     *
+     * See sci::set_overflow() and sci::set_overflow_timeout()
+     *
+     * @param policy What to do when the transmit buffer is full
+     * @param timeout For OVERFLOW_TIMEOUT, the wait in units of now()
+     * @param now For OVERFLOW_TIMEOUT, the time source
+     */
+    static void
+    set_overflow(Overflow policy, uint16_t timeout = 0,
+                 TickSource now = nullptr);
+
+    /**
+     * Get a consistent copy of the counters
+     *
+     * See sci::get_stats()
+     */
+    static void
+    get_stats(Stats &stats);
+
+    /**
+     * Zero the counters and high-water marks
+     */
+    static void
+    reset_stats();
+
+    /**
+     * Transmit a caller-owned buffer without copying it
+     *
+     * See sci::send_async()
+     */
+    static bool
+    send_async(const uint8_t *buf, size_t length, TxCallback callback,
+               bool progmem);
+
+    /**
+     * Check for an asynchronous send in progress
+     *
+     * See sci::async_busy()
+     */
+    static bool
+    async_busy();
+
+    /**
+     * Receive complete handler. Only to be called by the RX vector.
+     */
+    static void
+    rx_isr();
+
+    /**
+     * Data register empty handler. Only to be called by the UDRE vector.
+     */
+    static void
+    tx_isr();
+};
+
+
 /**
  * Initialize the SCI subsystem
  *
  * @param baud The desired baud rate
+ * @param bind_stdio Bind stdin and stdout to the SCI
  */
 void
-init(uint32_t baud);
+init(uint32_t baud, bool bind_stdio = true);
 
+/**
+ * Get the number of bytes waiting in the buffer behind a stream
+ *
+ * @param stream any stream bound by init() or Usart<N>
+ * @return Number of bytes buffered
+ */
 size_t
 size(FILE *stream);
 
+/**
+ * Queue a block of data for transmission
+ *
+ * Non-blocking. Copies as much of the block as currently fits in the transmit
+ * buffer in a single pass. No newline translation is done.
+ *
+ * @param src pointer to the source data
+ * @param length number of bytes to send
+ * @return Number of bytes queued
+ */
+inline size_t
+write(const void *src, size_t length) {
+    return Usart<0>::write(src, length);
+}
+
+/**
+ * Read a block of received data
+ *
+ * Non-blocking. Copies as much received data as is available, up to length,
+ * in a single pass.
+ *
+ * @param dst pointer to the destination buffer
+ * @param length maximum number of bytes to read
+ * @return Number of bytes read
+ */
+inline size_t
+read(void *dst, size_t length) {
+    return Usart<0>::read(dst, length);
+}
+
+/**
+ * Transmit a caller-owned buffer without copying it
+ *
+ * Non-blocking. The transmit ISR reads bytes directly from buf, so the buffer
+ * must remain valid and unmodified until the callback is run. The callback is
+ * run once the last byte has been handed to the UART.
+ *
+ * Anything queued through stdio or write() is sent ahead of the remaining
+ * asynchronous data, so avoid mixing the two if ordering matters.
+ *
+ * @param buf pointer to the data to send
+ * @param length number of bytes to send
+ * @param callback optional completion callback
+ * @return true if the send was started, false if one is already in progress
+ */
+inline bool
+send_async(const uint8_t *buf, size_t length, TxCallback callback = nullptr) {
+    return Usart<0>::send_async(buf, length, callback, false);
+}
+
+/**
+ * Transmit a buffer in program space without copying it
+ *
+ * Same as send_async(), but buf points to program memory (PROGMEM). As with
+ * the other avr-libc _P functions, buf must be within the first 64 KB.
+ *
+ * @param buf pointer to the data to send, in program space
+ * @param length number of bytes to send
+ * @param callback optional completion callback
+ * @return true if the send was started, false if one is already in progress
+ */
+inline bool
+send_async_P(const uint8_t *buf, size_t length,
+             TxCallback callback = nullptr) {
+    return Usart<0>::send_async(buf, length, callback, true);
+}
+
+/**
+ * Check for an asynchronous send in progress
+ *
+ * @return true if a send_async() buffer is still being transmitted
+ */
+inline bool
+async_busy() {
+    return Usart<0>::async_busy();
+}
+
+/**
+ * Set the USART0 stdout overflow policy
+ *
+ * Whatever the policy, stdout never deadlocks with interrupts disabled. In
+ * that case the transmitter is polled directly instead of waiting on its ISR.
+ * Discarded bytes are counted in Stats::tx_dropped.
+ *
+ * @param policy OVERFLOW_BLOCK, OVERFLOW_DROP_NEWEST or OVERFLOW_DROP_OLDEST
+ */
+inline void
+set_overflow(Overflow policy) {
+    Usart<0>::set_overflow(policy);
+}
+
+/**
+ * Wait at most the given time for room in the USART0 transmit buffer
+ *
+ * This selects OVERFLOW_TIMEOUT. The deadline is measured with
+ * clock::ticks(), so the clock must be running. Once a wait times out,
+ * further bytes are discarded without waiting until there is room again, so
+ * one long printf() costs at most a single timeout.
+ *
+ * @param ms Maximum wait, in milliseconds
+ */
+inline void
+set_overflow_timeout(uint16_t ms) {
+    Usart<0>::set_overflow(OVERFLOW_TIMEOUT, ms, clock::ticks);
+}
+
+/**
+ * Get a consistent copy of the USART0 counters
+ *
+ * All counters are read together with interrupts held off, so they agree
+ * with each other.
+ *
+ * @param[out] stats destination for the counters
+ */
+inline void
+get_stats(Stats &stats) {
+    Usart<0>::get_stats(stats);
+}
+
+/**
+ * Zero the USART0 counters and high-water marks
+ */
+inline void
+reset_stats() {
+    Usart<0>::reset_stats();
+}
+
+/**
+ * Terminal command to print the USART0 counters
+ *
+ * Add to a command list, e.g. {"sci", sci::stats_command, NULL}. Pass "reset"
+ * as the argument to zero the counters after printing them.
+ *
+ * @param args arguments from the command line
+ * @return 0
+ */
+uint8_t
+stats_command(char *args);
+
 /**
  * Calculate the UBRR setting based on the given baud
  *
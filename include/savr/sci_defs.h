@@ -136,4 +136,65 @@
 #define SAVR_NO_SCI
 #endif
 
+
+/**
+ * Second USART, where present (ATmega164P/324P/644P/1284P and variants)
+ *
+ * The bit layout of every control register matches USART0, so only the
+ * registers and vectors differ.
+ */
+#if !defined(SAVR_NO_SCI) && defined(UDR1)
+    #define SAVR_SCI_USART1
+    #define __BAUD1_HIGH   UBRR1H
+    #define __BAUD1_LOW    UBRR1L
+    #define __CTRL1A       UCSR1A
+    #define __CTRL1B       UCSR1B
+    #define __CTRL1C       UCSR1C
+    #define __DATA1R       UDR1
+    #define __RX1_VECT     USART1_RX_vect
+    #define __TX1_VECT     USART1_UDRE_vect
+#endif
+
+
+#if !defined(SAVR_NO_SCI)
+
+namespace savr {
+namespace sci {
+
+/**
+ * Register access for USART number N
+ *
+ * Only specialized for the USARTs present on the target, so using a missing
+ * USART is a compile-time error.
+ */
+template<uint8_t N>
+struct UsartRegs;
+
+template<>
+struct UsartRegs<0> {
+    static FORCE_INLINE volatile uint8_t &baud_high() { return __BAUD_HIGH; }
+    static FORCE_INLINE volatile uint8_t &baud_low()  { return __BAUD_LOW; }
+    static FORCE_INLINE volatile uint8_t &ctrla()     { return __CTRLA; }
+    static FORCE_INLINE volatile uint8_t &ctrlb()     { return __CTRLB; }
+    static FORCE_INLINE volatile uint8_t &ctrlc()     { return __CTRLC; }
+    static FORCE_INLINE volatile uint8_t &data()      { return __DATAR; }
+};
+
+#if defined(SAVR_SCI_USART1)
+template<>
+struct UsartRegs<1> {
+    static FORCE_INLINE volatile uint8_t &baud_high() { return __BAUD1_HIGH; }
+    static FORCE_INLINE volatile uint8_t &baud_low()  { return __BAUD1_LOW; }
+    static FORCE_INLINE volatile uint8_t &ctrla()     { return __CTRL1A; }
+    static FORCE_INLINE volatile uint8_t &ctrlb()     { return __CTRL1B; }
+    static FORCE_INLINE volatile uint8_t &ctrlc()     { return __CTRL1C; }
+    static FORCE_INLINE volatile uint8_t &data()      { return __DATA1R; }
+};
+#endif
+
+}
+}
+
+#endif
+
 #endif
@@ -30,24 +30,49 @@
  * This interface is somewhat bloated. It is not intended to be
  * fast, but instead helpful for debugging and learning.
  *
- * This library by default will compile in and use CRC checks. If you want
- * to disable this, compile with -DSD_NO_CRC.
+ * This library by default will compile in and use CRC checks. Every data
+ * block read is checked against its CRC, which is worked out while the
+ * bytes are clocked over SPI. If you want to disable this, compile with
+ * -DSD_NO_CRC. Commands are always sent with their CRC, since the card
+ * checks some of them regardless.
+ *
+ * Both standard (SDSC) and high capacity (SDHC/SDXC) cards are supported.
+ * read_block(), write_block() and erase_block() take byte addresses, so they
+ * reach the first 4 GiB of a card. The sector calls, the multi-block streams
+ * and the cache take 512-byte block numbers and reach all of it.
+ *
+ * The block cache (cache_block() and flush()) keeps recently used blocks in
+ * RAM and writes changes back lazily. Its size is set at build time with
+ * -DSD_CACHE_SLOTS=n (1 to 16, default 2), at 512 bytes plus a few per slot.
+ * The buffers are only linked in when the cache is used.
  */
 
 #include <stdint.h>
 #include <stddef.h>
 
 #include <savr/gpio.h>
+#include <savr/pt.h>
 
 namespace savr {
 namespace sd {
 
+//! SPI clock while the card initializes (the SD spec allows 100-400 kHz)
+constexpr uint32_t INIT_CLOCK = 400000;
+
+//! SPI clock once the card is up (25 MHz in default speed mode)
+constexpr uint32_t MAX_CLOCK = 25000000;
+
 /**
  * Initialize the SD card.
  *
  * Attempts to initialize an SD card on the SPI bus. Will go through the
  * standard initialization procedures, and then print out the CID and CSD in
- * hex.
+ * hex. The card gets its own spi::Device, run at INIT_CLOCK until it is up
+ * and at MAX_CLOCK (or the fastest the CPU allows) after.
+ *
+ * Version 2.00 cards are detected with CMD8 and brought up with ACMD41,
+ * announcing high capacity support; CMD58 then tells if the card is block
+ * addressed. Older cards fall back to ACMD41 without HCS, and MMC to CMD1.
  *
  * @param ss    the slave-select line for the card
  *
@@ -57,10 +82,22 @@ uint8_t
 init(gpio::Pin ss);
 
 
+/**
+ * Check if the card is high capacity (SDHC/SDXC, block addressed).
+ *
+ * Only valid after a successful init().
+ *
+ * @return true for a high capacity card
+ */
+bool
+high_capacity();
+
+
 /**
  * Read a block of data from the SD card.
  *
- * Will read a block of data into the specified buffer.
+ * Will read a block of data into the specified buffer. The data may not
+ * cross a 512byte block boundary.
  *
  * @param addr  a 32bit start address
  * @param data  a character pointer to the destination
@@ -88,6 +125,55 @@ uint8_t
 write_block(uint32_t addr, const uint8_t *data, size_t size);
 
 
+//! Longest a card may take to program a block (SD spec: 250ms for SDSC)
+constexpr uint16_t WRITE_TIMEOUT_MS = 250;
+
+/**
+ * Writes a block of data to the SD card, as a protothread.
+ *
+ * Same as write_block(), but waits for the card to finish programming with
+ * PT_WAIT instead of spinning, and releases the slave select between checks
+ * so other devices can use the bus. Call until it returns pt::ENDED, with the
+ * same arguments each time. If the card rejects the data it ends at once,
+ * without waiting. See pt.h.
+ *
+ * @param self      protothread state
+ * @param addr      the start address (32bit, must be block aligned)
+ * @param data      pointer to the source of data to write
+ * @param size      the size of the source data
+ * @param result    set to 1 if sucessful, 0 otherwise
+ */
+pt::State
+write_block_pt(pt::Pt *self, uint32_t addr, const uint8_t *data, size_t size,
+               uint8_t &result);
+
+
+/**
+ * Reads a whole 512byte block, by block number.
+ *
+ * @param block the 512byte block number
+ * @param buf   destination, at least 512 bytes
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+read_sector(uint32_t block, uint8_t *buf);
+
+
+/**
+ * Writes a whole 512byte block, by block number.
+ *
+ * Returns once the card has finished programming.
+ *
+ * @param block the 512byte block number
+ * @param data  source, 512 bytes
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+write_sector(uint32_t block, const uint8_t *data);
+
+
 /**
  * Erases a block of data from the SD card.
  *
@@ -102,6 +188,156 @@ write_block(uint32_t addr, const uint8_t *data, size_t size);
 uint8_t
 erase_block(uint32_t addr, uint32_t size);
 
+
+/**
+ * Starts a multi-block read (CMD18).
+ *
+ * Blocks are then fetched in order with read_next() until read_end(). The
+ * card stays selected for the whole stream, so nothing else may use the SPI
+ * bus until read_end() is called. Only one stream may be open at a time.
+ *
+ * @param block the first 512byte block number
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+read_begin(uint32_t block);
+
+
+/**
+ * Reads the next 512byte block of a multi-block read.
+ *
+ * @param buf   destination, at least 512 bytes
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+read_next(uint8_t *buf);
+
+
+/**
+ * Ends a multi-block read (CMD12) and releases the bus.
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+read_end();
+
+
+/**
+ * Starts a multi-block write (CMD25).
+ *
+ * Blocks are then sent in order with write_next() until write_end(). The
+ * card stays selected for the whole stream, so nothing else may use the SPI
+ * bus until write_end() is called. Only one stream may be open at a time.
+ *
+ * @param block     the first 512byte block number
+ * @param pre_erase if nonzero, the number of blocks about to be written,
+ *                  passed to the card as a pre-erase hint (ACMD23)
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+write_begin(uint32_t block, uint32_t pre_erase = 0);
+
+
+/**
+ * Writes the next 512byte block of a multi-block write.
+ *
+ * Returns once the card has taken the block and is no longer busy.
+ *
+ * @param data  source, 512 bytes
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+write_next(const uint8_t *data);
+
+
+/**
+ * Ends a multi-block write (stop token) and releases the bus.
+ *
+ * Waits for the card to finish programming the last block.
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+write_end();
+
+
+
+//! Block cache counters, since the last reset
+typedef struct {
+    uint16_t hits;          ///< Lookups served from RAM
+    uint16_t misses;        ///< Lookups that read the card
+    uint16_t writebacks;    ///< Dirty blocks written to the card
+} CacheStats;
+
+
+/**
+ * Get a block through the cache.
+ *
+ * Returns the cached copy of the block, reading it from the card on a miss.
+ * The least recently used slot is reused for it, and written back first if
+ * dirty. Pass dirty=true when the caller will change the data, so it is
+ * written back later; changes are only guaranteed on the card after flush().
+ *
+ * The pointer stays valid until the next cache_block(), cache_new() or
+ * cache_invalidate() call.
+ *
+ * Blocks written with the other calls while cached are not seen by the
+ * cache; call cache_invalidate() (after a flush()) if mixing the two.
+ *
+ * @param block the 512byte block number
+ * @param dirty mark the block as changed
+ *
+ * @return the 512 bytes of the block, or NULL on a card error
+ */
+uint8_t *
+cache_block(uint32_t block, bool dirty = false);
+
+
+/**
+ * Get a block through the cache, for a caller that will overwrite all of it.
+ *
+ * Like cache_block(block, true), but a miss does not read the card: the
+ * slot keeps whatever it held before, and the caller must fill all 512
+ * bytes.
+ *
+ * @param block the 512byte block number
+ *
+ * @return the 512 bytes of the block, or NULL on a card error
+ */
+uint8_t *
+cache_new(uint32_t block);
+
+
+/**
+ * Write all dirty cached blocks back to the card.
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+flush();
+
+
+/**
+ * Drop everything in the cache, without writing dirty blocks back.
+ */
+void
+cache_invalidate();
+
+
+/**
+ * Get the cache counters.
+ *
+ * @param reset clear the counters after reading them
+ *
+ * @return the counters
+ */
+CacheStats
+cache_stats(bool reset = false);
+
 }
 }
 
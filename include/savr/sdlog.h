@@ -0,0 +1,167 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_sdlog_h_included_
+#define _savr_sdlog_h_included_
+
+/**
+ * @file sdlog.h
+ *
+ * Append-only record log on raw SD blocks
+ *
+ * For loggers that append fixed-size records and read them back in order,
+ * without a filesystem. The log takes a range of blocks on the card and
+ * fills it one 512-byte page at a time, wrapping around to overwrite the
+ * oldest page when the range is full.
+ *
+ * Each page holds a sequence number, the record size and count, as many
+ * whole records as fit, and a CRC-16 over all of it:
+ *
+ *     0   magic "SL"
+ *     2   sequence number (32-bit, little endian)
+ *     6   record size (16-bit)
+ *     8   record count (16-bit)
+ *    10   records...
+ *   510   CRC-16 (CCITT polynomial, big endian)
+ *
+ * Pages are written in sequence order around the range, so the sequence
+ * numbers rise by one from block to block except at the newest page. mount()
+ * finds it with a binary search: 27 block reads for a 4 GiB range,
+ * instead of reading every block.
+ *
+ * Records are buffered in RAM until a page fills or sync() is called;
+ * sync() rewrites the partial newest page in place. A page torn by a reset
+ * during that write fails its CRC, and the log ends at the page before it;
+ * the older pages are kept.
+ *
+ * The log keeps a single 512-byte page buffer, shared by append() and
+ * read(). Reading away from the newest page syncs it first.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace savr {
+namespace sdlog {
+
+//! Largest record that fits in a page
+constexpr uint16_t MAX_RECORD = 500;
+
+//! Position in the log for read()
+typedef struct {
+    uint32_t seq;       ///< Sequence number of the page
+    uint16_t index;     ///< Next record in the page
+} Reader;
+
+
+/**
+ * Open the log on the card.
+ *
+ * The card must already be set up with sd::init(). Finds the newest and
+ * oldest pages of a log already on the blocks, or starts an empty one. Use
+ * the same range and record size every time; clear() the log to change the
+ * record size.
+ *
+ * @param first         first block of the range
+ * @param blocks        number of blocks in the range, at least 2
+ * @param record_size   bytes per record, 1 to MAX_RECORD
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+mount(uint32_t first, uint32_t blocks, uint16_t record_size);
+
+
+/**
+ * Append a record.
+ *
+ * The page is written to the card when it fills.
+ *
+ * @param record    record_size bytes
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+append(const void *record);
+
+
+/**
+ * Write any buffered records to the card.
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+sync();
+
+
+/**
+ * Drop every record in the log.
+ *
+ * Writes an empty page at the start of the range, numbered past anything
+ * that was there, so the old pages are never taken for part of the log. The
+ * last block of the range is wiped first, so a reset part way through
+ * leaves either the old log or an empty one.
+ * Also works after a mount() that failed on the record size.
+ *
+ * @param record_size   bytes per record from now on, 1 to MAX_RECORD
+ *
+ * @return 1 if sucessful, 0 otherwise
+ */
+uint8_t
+clear(uint16_t record_size);
+
+
+/**
+ * Number of records in the log.
+ *
+ * @return the record count
+ */
+uint32_t
+count();
+
+
+/**
+ * Point a reader at the oldest record.
+ *
+ * @param reader    the reader
+ */
+void
+rewind(Reader &reader);
+
+
+/**
+ * Read the next record.
+ *
+ * Picks up records appended since the last call. If the writer has wrapped
+ * around over the reader's position, skips ahead to the oldest record.
+ *
+ * @param reader    the reader
+ * @param record    set to the record, record_size bytes
+ *
+ * @return 1 if a record was read, 0 at the end of the log or on an error
+ */
+uint8_t
+read(Reader &reader, void *record);
+
+}
+}
+
+#endif /* _savr_sdlog_h_included_ */
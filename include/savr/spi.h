@@ -28,15 +28,65 @@
  * A simple SPI interface.
  *
  * Notes:
- *  The SS line must be manually set by the user.
+ *  The SS line must be manually set by the user, or handled by a Device.
+ *  Drivers sharing the bus each keep a Device (SS pin, clock and mode) and
+ *  wrap their transfers in begin()/end(). The bus is reconfigured only when
+ *  a begin() is for a device with different settings to the last one.
+ *  transfer_async() runs a block in the background from the SPI interrupt.
+ *  None of the blocking calls may be used until it has finished.
  */
 
 #include <stdint.h>
 #include <stddef.h>
 
+#include <savr/gpio.h>
+
 namespace savr {
 namespace spi {
 
+//! Clock polarity and phase, as SPCR bits
+typedef enum {
+    MODE_0 = 0x00,      ///< CPOL 0, CPHA 0
+    MODE_1 = 0x04,      ///< CPOL 0, CPHA 1
+    MODE_2 = 0x08,      ///< CPOL 1, CPHA 0
+    MODE_3 = 0x0C,      ///< CPOL 1, CPHA 1
+} Mode;
+
+
+/**
+ * A device on the shared bus
+ *
+ * Holds the register settings for the device's clock and mode, worked out
+ * once up front, and its slave select pin.
+ */
+struct Device {
+    gpio::Pin ss;       ///< Slave select, active low
+    uint8_t spcr;       ///< SPCR while this device is selected
+    uint8_t spsr;       ///< SPSR (SPI2X) while this device is selected
+
+    //! An unconfigured device; assign a configured one before use
+    constexpr Device() : ss(gpio::B0), spcr(0), spsr(0) {}
+
+    /**
+     * Set up a device, and drive its SS pin high (deselected)
+     *
+     * @param ss        Slave select pin
+     * @param max_freq  Fastest SPI clock the device takes. The closest
+     *                  clock at or below it is used.
+     * @param mode      Clock polarity and phase
+     */
+    Device(gpio::Pin ss, uint32_t max_freq, Mode mode = MODE_0);
+
+    /**
+     * Change the device's clock, e.g. once a card is out of its init phase
+     *
+     * @param max_freq  Fastest SPI clock the device takes
+     */
+    void
+    set_clock(uint32_t max_freq);
+};
+
+
 /**
  * Initialize the SPI subsystem
  *
@@ -46,6 +96,32 @@ void
 init(uint32_t spi_freq);
 
 
+/**
+ * Set the bus up for a device, without selecting it
+ *
+ * Only writes the registers if they differ from the device's settings.
+ * Used by begin(), and for clocking a device with SS high.
+ */
+void
+configure(const Device &device);
+
+
+/**
+ * Start a transaction: configure the bus for the device and select it
+ *
+ * spi::init() must have been called (at any clock) to set up the pins.
+ */
+void
+begin(const Device &device);
+
+
+/**
+ * End a transaction: deselect the device
+ */
+void
+end(const Device &device);
+
+
 /**
  * Write (send) a block of data over the SPI
  *
@@ -67,6 +143,47 @@ void
 read_block(uint8_t *input, size_t length, uint8_t filler);
 
 
+/**
+ * Send and receive a block of data over the SPI
+ *
+ * @param input a pointer to the source data
+ * @param output a pointer to the destination buffer (may be input)
+ * @param length the number of bytes
+ */
+void
+trx_block(const uint8_t *input, uint8_t *output, size_t length);
+
+
+/**
+ * Write a block and update a CRC-16 (XMODEM) over the bytes sent
+ *
+ * The CRC of each byte is worked out while the next one shifts, so it
+ * costs little more than write_block().
+ *
+ * @param input a pointer to the source data
+ * @param length the size of the source data
+ * @param crc the CRC so far
+ *
+ * @return the updated CRC
+ */
+uint16_t
+write_block_crc(const uint8_t *input, size_t length, uint16_t crc);
+
+
+/**
+ * Read a block and update a CRC-16 (XMODEM) over the bytes received
+ *
+ * @param output a pointer to the destination buffer
+ * @param length the number of bytes to read
+ * @param filler a byte to send continuously while reading
+ * @param crc the CRC so far
+ *
+ * @return the updated CRC
+ */
+uint16_t
+read_block_crc(uint8_t *output, size_t length, uint8_t filler, uint16_t crc);
+
+
 /**
  * Tx/Rx a byte
  *
@@ -78,6 +195,52 @@ uint8_t
 trx_byte(uint8_t input);
 
 
+//! Called from the SPI interrupt when an async transfer has finished
+typedef void (*Callback)(void *arg);
+
+
+/**
+ * Start a background transfer
+ *
+ * Each byte is shifted from the SPI interrupt, so the CPU is free between
+ * bytes. The interrupt costs around 60 cycles a byte and a byte takes 8
+ * SPI clocks, so this only pays off from fck/16 down. At faster clocks the
+ * blocking calls are quicker and leave little CPU time to gain (see
+ * tests/spi_bench). Interrupts must be enabled.
+ *
+ * The buffers must stay valid until the transfer finishes. The callback
+ * runs in the interrupt, with the bus idle; it may start the next
+ * transfer.
+ *
+ * @param tx        Bytes to send, or nullptr to send filler
+ * @param rx        Where to store received bytes, or nullptr to discard
+ * @param length    Number of bytes
+ * @param callback  Called when done, or nullptr
+ * @param arg       Passed to the callback
+ * @param filler    Byte sent when tx is nullptr
+ *
+ * @return false if a transfer is already running, true otherwise
+ */
+bool
+transfer_async(const uint8_t *tx, uint8_t *rx, size_t length,
+               Callback callback = nullptr, void *arg = nullptr,
+               uint8_t filler = 0xFF);
+
+
+/**
+ * Check if an async transfer is running
+ */
+bool
+busy();
+
+
+/**
+ * Wait for an async transfer to finish
+ */
+void
+wait();
+
+
 /**
  * Set the default SS line for this chip high
  */
@@ -0,0 +1,163 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_task_h_included_
+#define _savr_task_h_included_
+
+/**
+ * @file task.h
+ *
+ * Cooperative task scheduler
+ *
+ * A Task is a function that runs to completion each time it is scheduled.
+ * It stays runnable by asking to be run again: right away with yield(),
+ * after a delay with sleep(), or when an event calls wake(). Tasks share the
+ * one stack, so there is no per-task RAM beyond the Task itself.
+ *
+ * Ready tasks run in the order they became ready. Delayed tasks are kept in
+ * wake-time order and released by a clock::Timer, so clock::idle() sleeps
+ * exactly until the next one is due. wake() may be called from an ISR.
+ *
+ * The scheduler needs the clock (clock::init()) for delays.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <savr/clock.h>
+
+#ifndef CLOCK_NO_TIMERS
+
+namespace savr {
+namespace task {
+
+/**
+ * Task body
+ *
+ * @param arg The argument given to the Task
+ */
+typedef void (*TaskFunc)(void *arg);
+
+/**
+ * Task states
+ */
+constexpr uint8_t TASK_IDLE = 0;        ///< Waiting for wake()
+constexpr uint8_t TASK_READY = 1;       ///< In the run queue
+constexpr uint8_t TASK_DELAYED = 2;     ///< Waiting for its wake tick
+
+/**
+ * A task control block
+ *
+ * The storage is owned by the caller, usually static. The fields are
+ * managed by the scheduler; only set them through the constructor.
+ */
+struct Task {
+    Task *next;             ///< Next in the ready or delayed list
+    uint32_t wake_tick;     ///< When a delayed task becomes ready
+    TaskFunc func;
+    void *arg;
+    volatile uint8_t state;
+
+    constexpr Task(TaskFunc task_func, void *task_arg = nullptr) noexcept :
+        next(nullptr), wake_tick(0), func(task_func), arg(task_arg),
+        state(TASK_IDLE) {
+    }
+};
+
+/**
+ * Make a task ready to run
+ *
+ * Safe to call from an ISR. A delayed task is made ready early. A task that
+ * is already ready is left where it is in the queue.
+ *
+ * @param task The task to run
+ */
+void
+wake(Task &task);
+
+/**
+ * Run a task after a delay
+ *
+ * Replaces any earlier delay or wake.
+ *
+ * @param task The task to run
+ * @param delay Ticks (milliseconds) from now
+ */
+void
+sleep(Task &task, uint32_t delay);
+
+/**
+ * Run a task again, after every other ready task has had its turn
+ *
+ * @param task The task to run
+ */
+inline void
+yield(Task &task) {
+    wake(task);
+}
+
+/**
+ * Take a task out of the ready or delayed list
+ *
+ * @param task The task to stop
+ */
+void
+cancel(Task &task);
+
+/**
+ * Get the task that is running now
+ *
+ * @return The running task, or nullptr outside of a task
+ */
+Task *
+current();
+
+/**
+ * Run one ready task
+ *
+ * Deferred clock timers are run first.
+ *
+ * @return true if a task was run
+ */
+bool
+run_once();
+
+/**
+ * Run tasks forever
+ *
+ * Each pass runs any deferred clock timers, every task that is ready, then
+ * the poll function, if any.
+ * With nothing left to run, the CPU sleeps in clock::idle() until a delay
+ * runs out or an interrupt arrives. For a terminal alongside the tasks:
+ *
+ *     task::run(term::work);
+ *
+ * @param poll Function to call on every pass, or nullptr
+ */
+[[noreturn]] void
+run(void (*poll)() = nullptr);
+
+}
+}
+
+#endif
+
+#endif /* _savr_task_h_included_ */
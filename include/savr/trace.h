@@ -0,0 +1,147 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_trace_h_included_
+#define _savr_trace_h_included_
+
+/**
+ * @file trace.h
+ *
+ * Binary event trace
+ *
+ * SAVR_TRACE(event, arg) writes one record to a RAM ring. A record is the
+ * low 16 bits of clock::ticks(), an event ID, and a 16-bit argument. No
+ * formatting is done, so a record costs a few tens of cycles and changes
+ * the timing of the code under test far less than a printf would. When the
+ * ring is full the oldest records are overwritten, so after a failure it
+ * holds the events leading up to it.
+ *
+ * command() prints the ring as hex for tools/trace_decode.py to turn back
+ * into text. The library drivers (sci, spi, sd, rfm69, twi, w1) record
+ * their own events; applications can use EV_USER and up.
+ *
+ * Build-time settings:
+ *   -DSAVR_TRACE_ENABLE    Turn tracing on. Without it SAVR_TRACE() compiles
+ *                          to nothing and command() does nothing. Use the
+ *                          same setting for the library and the application.
+ *   -DTRACE_RECORDS=n      Ring size (power of two up to 128, default 32).
+ *                          Each record takes 5 bytes.
+ */
+
+#include <stdint.h>
+
+namespace savr {
+namespace trace {
+
+/**
+ * Event IDs
+ *
+ * Each driver has its own block of 16. tools/trace_decode.py reads the
+ * names from this list, so keep one "EV_NAME = value," per line.
+ */
+typedef enum {
+    EV_NONE             = 0x00,
+
+    EV_SCI_RX_ERROR     = 0x10,     ///< arg: USART << 8 | error bits
+    EV_SCI_RX_DROP      = 0x11,     ///< arg: USART << 8 | byte
+    EV_SCI_TX_DROP      = 0x12,     ///< arg: USART
+
+    EV_SPI_WRITE        = 0x20,     ///< arg: length
+    EV_SPI_READ         = 0x21,     ///< arg: length
+    EV_SPI_ASYNC        = 0x22,     ///< arg: length
+    EV_SPI_TRX          = 0x23,     ///< arg: length
+
+    EV_SD_CMD           = 0x30,     ///< arg: command << 8 | low byte of the argument
+    EV_SD_RESP          = 0x31,     ///< arg: polls << 8 | first response byte
+    EV_SD_ERROR         = 0x32,     ///< arg: command << 8 | response
+    EV_SD_DATA_REJECT   = 0x33,     ///< arg: data response
+    EV_SD_BUSY          = 0x34,     ///< arg: busy polls after a write
+
+    EV_RFM_MODE         = 0x40,     ///< arg: mode
+    EV_RFM_TX           = 0x41,     ///< arg: length
+    EV_RFM_RX           = 0x42,     ///< arg: packet length
+    EV_RFM_TIMEOUT      = 0x43,     ///< arg: timeout (ms)
+
+    EV_TWI_ADDRESS      = 0x50,     ///< arg: address << 8 | bus status
+    EV_TWI_STOP         = 0x51,     ///< arg: 0
+    EV_TWI_TIMEOUT      = 0x52,     ///< arg: bus status
+
+    EV_W1_RESET         = 0x60,     ///< arg: 1 if a device answered
+
+    EV_USER             = 0x80,     ///< First application event
+} Event;
+
+
+/**
+ * One trace record
+ */
+typedef struct {
+    uint16_t tick;      ///< Low 16 bits of clock::ticks()
+    uint8_t event;      ///< Event ID
+    uint16_t arg;       ///< Event argument
+} Record;
+
+
+/**
+ * Add a record
+ *
+ * Safe from ISRs. Prefer SAVR_TRACE(), which compiles out when tracing is
+ * off.
+ *
+ * @param event Event ID
+ * @param arg   Event argument
+ */
+void
+record(uint8_t event, uint16_t arg);
+
+
+/**
+ * Empty the ring
+ */
+void
+clear();
+
+
+/**
+ * Terminal command: print the ring as hex, oldest first
+ *
+ * Output is "@trace <records> <lost>", lines of 10 hex digits per record
+ * (tick, event, arg), then "@end". Recording is paused while printing, so
+ * the dump does not trace itself. "reset" as the argument empties the ring
+ * afterwards.
+ *
+ * @param args  "reset" or empty
+ * @return 0
+ */
+uint8_t
+command(char *args);
+
+}
+}
+
+
+#ifdef SAVR_TRACE_ENABLE
+#define SAVR_TRACE(event, arg) ::savr::trace::record((event), (arg))
+#else
+#define SAVR_TRACE(event, arg) do {} while (0)
+#endif
+
+#endif /* _savr_trace_h_included_ */
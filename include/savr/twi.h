@@ -27,6 +27,8 @@
 
 #include <util/twi.h>
 
+#include <savr/pt.h>
+
 #if defined(TWBR) && defined(TWCR) // Not everything has a TWI
 
 namespace savr {
@@ -135,14 +137,71 @@ uint8_t
 state();
 
 
+/**
+ * Check if the current bus operation has finished
+ */
+static inline bool
+ready() {
+    return TWCR & _BV(TWINT);
+}
+
+
 /**
  * Polling wait on the TWI bus
  */
 static inline void
 wait() {
-    while (!(TWCR & _BV(TWINT)));
+    while (!ready());
 }
 
+
+//! How long the protothread versions wait for any one bus operation
+constexpr uint16_t PT_TIMEOUT_MS = 10;
+
+/**
+ * Addresses the given endpoint for read or write, as a protothread
+ *
+ * Same as address(), but each bus operation is waited on with PT_WAIT, so
+ * other work runs while the bytes are clocked out. A bus operation taking
+ * longer than PT_TIMEOUT_MS (a stuck bus) fails instead of hanging. Call
+ * until it returns pt::ENDED, with the same arguments each time; it ends on
+ * failure too, with result non-zero. See pt.h.
+ *
+ * @param self      Protothread state
+ * @param address   The address of the endpoint
+ * @param read      True to read, false to write
+ * @param result    Set to 0 on success, non-zero on error
+ */
+pt::State
+address_pt(pt::Pt *self, uint8_t address, bool read, uint8_t &result);
+
+
+/**
+ * Send a byte, as a protothread
+ *
+ * See address_pt() and send().
+ *
+ * @param self      Protothread state
+ * @param b         The byte to send
+ * @param result    Set to 0 on success, non-zero on timeout
+ */
+pt::State
+send_pt(pt::Pt *self, uint8_t b, uint8_t &result);
+
+
+/**
+ * Read a byte, as a protothread
+ *
+ * See address_pt(), get() and get_ack().
+ *
+ * @param self      Protothread state
+ * @param ack       True to acknowledge the byte (more to follow)
+ * @param data      Set to the byte read
+ * @param result    Set to 0 on success, non-zero on timeout
+ */
+pt::State
+get_pt(pt::Pt *self, bool ack, uint8_t &data, uint8_t &result);
+
 }
 }
 
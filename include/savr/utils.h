@@ -42,6 +42,7 @@
  */
 #define ISAVR(x) defined(__AVR_ ## x ## __)
 #define FORCE_INLINE __attribute__((always_inline)) inline
+#define COMPILER_BARRIER() asm volatile("" ::: "memory")
 
 
 namespace savr {
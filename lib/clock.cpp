@@ -23,6 +23,7 @@
 #include <avr/io.h>
 #include <util/atomic.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <inttypes.h>
 #include <stdio.h>
 
@@ -30,6 +31,8 @@
 #include <savr/optimized.h>
 #include <savr/clock.h>
 
+#include "sleep_regs.h"
+
 
 using namespace savr;
 
@@ -39,11 +42,13 @@ using namespace savr;
 #define __WGM_REG TCCR2
 #define __WGM_BIT(n) _BV(WGM2##n)
 #define __OCR_REG OCR2
+#define __CNT_REG TCNT2
 #define __INT_MSK_REG TIMSK
 #define __INT_FLG_REG TIFR
 #define __INT_MSK_MASK _BV(OCIE2)
 #define __INT_FLG_MASK _BV(OCF2)
 #define __INT_VECT TIMER2_COMP_vect
+#define __PRESCALE_RESET() (SFIOR |= _BV(PSR2))
 
 #elif defined(TCCR2B)
 #define __PRESCALE_REG TCCR2B
@@ -51,11 +56,13 @@ using namespace savr;
 #define __WGM_REG TCCR2A
 #define __WGM_BIT(n) _BV(WGM2##n)
 #define __OCR_REG OCR2A
+#define __CNT_REG TCNT2
 #define __INT_MSK_REG TIMSK2
 #define __INT_FLG_REG TIFR2
 #define __INT_MSK_MASK _BV(OCIE2A)
 #define __INT_FLG_MASK _BV(OCF2A)
 #define __INT_VECT TIMER2_COMPA_vect
+#define __PRESCALE_RESET() (GTCCR |= _BV(PSRASY))
 
 #elif defined(TCCR0)
 #define __PRESCALE_REG TCCR0
@@ -63,6 +70,7 @@ using namespace savr;
 #define __WGM_REG TCCR0
 #define __WGM_BIT(n) _BV(WGM0##n)
 #define __OCR_REG OCR0
+#define __CNT_REG TCNT0
 #define __INT_MSK_REG TIMSK
 #define __INT_FLG_REG TIFR
 #define __INT_MSK_MASK _BV(OCIE0)
@@ -101,6 +109,142 @@ static_assert(prescale_reg_val() != 0, "Invalid clock prescale");
 volatile uint32_t _ticks;
 
 
+#ifndef CLOCK_NO_TIMERS
+
+#ifndef CLOCK_TIMER_SLOTS
+#define CLOCK_TIMER_SLOTS 8
+#endif
+
+namespace {
+
+constexpr uint8_t WHEEL_SLOTS = CLOCK_TIMER_SLOTS;
+constexpr uint8_t WHEEL_MASK = WHEEL_SLOTS - 1;
+
+static_assert(WHEEL_SLOTS != 0 && (WHEEL_SLOTS & WHEEL_MASK) == 0,
+              "CLOCK_TIMER_SLOTS must be a power of two");
+
+/// Armed timers, hashed on the low bits of their expiry tick
+clock::Timer *_wheel[WHEEL_SLOTS];
+
+/// Expired deferred timers, oldest first
+clock::Timer *_pending_head;
+clock::Timer **_pending_tail = &_pending_head;
+
+
+/**
+ * Put a timer in its wheel slot. Interrupts must be disabled.
+ *
+ * A deadline that has already passed goes in the next tick's slot, so it is
+ * never missed by a whole revolution of the wheel.
+ */
+void
+wheel_insert(clock::Timer &timer, uint32_t now) {
+    uint32_t slot_tick = timer.expires;
+    if (static_cast<int32_t>(slot_tick - now) <= 0) {
+        slot_tick = now + 1;
+    }
+
+    clock::Timer **head = &_wheel[slot_tick & WHEEL_MASK];
+    timer.next = *head;
+    if (timer.next) {
+        timer.next->pprev = &timer.next;
+    }
+    timer.pprev = head;
+    *head = &timer;
+    timer.flags |= clock::TIMER_ARMED;
+}
+
+
+/**
+ * Take a timer out of the wheel. Interrupts must be disabled.
+ */
+void
+wheel_remove(clock::Timer &timer) {
+    *timer.pprev = timer.next;
+    if (timer.next) {
+        timer.next->pprev = timer.pprev;
+    }
+    timer.next = nullptr;
+    timer.pprev = nullptr;
+    timer.flags &= ~clock::TIMER_ARMED;
+}
+
+
+/**
+ * Take a timer off the deferred queue. Interrupts must be disabled.
+ *
+ * The queue only holds timers that have expired and not yet run, so the
+ * search is short.
+ */
+void
+pending_remove(clock::Timer &timer) {
+    clock::Timer **link = &_pending_head;
+    while (*link != &timer) {
+        link = &(*link)->pending;
+    }
+
+    *link = timer.pending;
+    if (_pending_tail == &timer.pending) {
+        _pending_tail = link;
+    }
+    timer.pending = nullptr;
+    timer.flags &= ~clock::TIMER_PENDING;
+}
+
+
+/**
+ * Fire every expired timer in one wheel slot
+ *
+ * Called from the tick ISR for the current tick's slot, and by idle() to
+ * catch up on the ticks it slept through. Interrupts must be disabled.
+ *
+ * @par Implementation Notes:
+ * Periodic timers are re-armed before their callback runs, so the callback
+ * may stop them. An ISR callback may also change the slot being walked, so
+ * the walk restarts from the head after each one. A re-armed timer always
+ * lands in a later tick, so it is never fired twice in one walk.
+ */
+FORCE_INLINE void
+expire_slot(uint8_t slot, uint32_t now) {
+    clock::Timer **head = &_wheel[slot];
+    clock::Timer *timer = *head;
+
+    while (timer) {
+        if (static_cast<int32_t>(now - timer->expires) < 0) {
+            // Due on a later revolution of the wheel
+            timer = timer->next;
+            continue;
+        }
+
+        clock::Timer *next = timer->next;
+        wheel_remove(*timer);
+        if (timer->period) {
+            timer->expires += timer->period;
+            wheel_insert(*timer, now);
+        }
+
+        if (timer->flags & clock::TIMER_IN_ISR) {
+            timer->callback(timer->arg);
+            timer = *head;
+            continue;
+        }
+
+        // A deferred timer that is still queued has overrun; run it once
+        if ((timer->flags & clock::TIMER_PENDING) == 0) {
+            timer->flags |= clock::TIMER_PENDING;
+            timer->pending = nullptr;
+            *_pending_tail = timer;
+            _pending_tail = &timer->pending;
+        }
+        timer = next;
+    }
+}
+
+}
+
+#endif
+
+
 /**
  * Initialize the clock system.
  */
@@ -115,7 +259,8 @@ clock::init() {
     __PRESCALE_REG = 0;
     __WGM_REG = 0;
 
-    __OCR_REG = clock::OCR_VALUE;
+    // CTC counts 0..OCR inclusive, so a period of OCR_VALUE needs OCR_VALUE-1
+    __OCR_REG = clock::OCR_VALUE - 1;
     __INT_MSK_REG = __INT_MSK_MASK;
 
     // Enable the counter last
@@ -133,6 +278,45 @@ clock::ticks() {
 }
 
 
+/**
+ * Read the tick count and timer counter as one consistent pair
+ *
+ * @par Implementation Notes:
+ * The counter is read before the compare flag. If the flag is set, the
+ * counter has wrapped without the ISR running yet; that tick is added unless
+ * the counter was read at TOP, i.e. just before the wrap.
+ */
+static FORCE_INLINE void
+read_counter(uint32_t &ticks, uint8_t &count) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        count = __CNT_REG;
+        ticks = _ticks;
+        if ((__INT_FLG_REG & __INT_FLG_MASK) &&
+                count != clock::OCR_VALUE - 1) {
+            ticks++;
+        }
+    }
+}
+
+
+uint32_t
+clock::micros() {
+    uint32_t ticks;
+    uint8_t count;
+    read_counter(ticks, count);
+    return ticks * US_PER_TICK + count * US_PER_COUNT;
+}
+
+
+uint32_t
+clock::cycles() {
+    uint32_t ticks;
+    uint8_t count;
+    read_counter(ticks, count);
+    return (ticks * OCR_VALUE + count) * CLOCK_SCALE;
+}
+
+
 uint8_t
 clock::ticks_byte() {
     static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
@@ -140,8 +324,314 @@ clock::ticks_byte() {
 }
 
 
+uint16_t
+clock::ticks_word() {
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+    return *reinterpret_cast<volatile uint16_t*>(&_ticks);
+}
+
+
+#ifndef CLOCK_NO_TIMERS
+
+void
+clock::start_timer(Timer &timer, uint32_t delay, uint32_t period) {
+    if (delay == 0) {
+        delay = 1;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (timer.flags & TIMER_ARMED) {
+            wheel_remove(timer);
+        }
+        uint32_t now = _ticks;
+        timer.expires = now + delay;
+        timer.period = period;
+        wheel_insert(timer, now);
+    }
+}
+
+
+void
+clock::stop_timer(Timer &timer) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (timer.flags & TIMER_ARMED) {
+            wheel_remove(timer);
+        }
+        if (timer.flags & TIMER_PENDING) {
+            pending_remove(timer);
+        }
+    }
+}
+
+
+/**
+ * Run deferred timer callbacks
+ *
+ * @par Implementation Notes:
+ * Each timer is dequeued with interrupts disabled, then its callback is run
+ * with them restored, so the tick ISR is never held off by a callback.
+ */
+uint8_t
+clock::run_timers() {
+    uint8_t count = 0;
+
+    for (;;) {
+        Timer *timer;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            timer = _pending_head;
+            if (timer) {
+                pending_remove(*timer);
+            }
+        }
+
+        if (timer == nullptr) {
+            return count;
+        }
+
+        timer->callback(timer->arg);
+        count++;
+    }
+}
+
+#endif
+
+
+#if defined(__PRESCALE_RESET)
+
+namespace {
+
+/// Timer2's largest prescaler, used while stretched
+constexpr uint8_t PRESCALE_SLOW =
+    __PRESCALE_BIT(2) | __PRESCALE_BIT(1) | __PRESCALE_BIT(0);
+
+/// Tick-rate counts per stretched count
+constexpr uint16_t SLOW_RATIO = 1024 / clock::CLOCK_SCALE;
+
+static_assert(SLOW_RATIO * clock::CLOCK_SCALE == 1024,
+              "Invalid clock prescale");
+
+/// Set while idle() has the timer stretched; the ISR then only wakes the CPU
+volatile bool _stretched;
+
+/// Set by the ISR when a stretched period ran out
+volatile bool _stretch_expired;
+
+
+/**
+ * Get the number of ticks until the next timer is due. Interrupts must be
+ * disabled.
+ *
+ * @return Ticks to the earliest deadline, 0 if one is due now, or
+ *         UINT32_MAX with no timers armed
+ */
+uint32_t
+ticks_to_deadline(uint32_t now) {
+    uint32_t shortest = UINT32_MAX;
+#ifndef CLOCK_NO_TIMERS
+    if (_pending_head) {
+        return 0;
+    }
+
+    for (uint8_t slot = 0; slot < WHEEL_SLOTS; ++slot) {
+        for (clock::Timer *timer = _wheel[slot]; timer; timer = timer->next) {
+            int32_t left = static_cast<int32_t>(timer->expires - now);
+            if (left <= 0) {
+                return 0;
+            }
+            if (static_cast<uint32_t>(left) < shortest) {
+                shortest = left;
+            }
+        }
+    }
+#else
+    (void)now;
+#endif
+    return shortest;
+}
+
+
+/**
+ * Sleep with interrupts enabled, returning with them disabled
+ *
+ * Idle mode is only selected for the sleep; the application's mode is put
+ * back afterwards.
+ */
+FORCE_INLINE void
+sleep_once() {
+    uint8_t mode = get_sleep_mode();
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    cli();
+    sleep_disable();
+    restore_sleep_mode(mode);
+}
+
+}
+
+
+/**
+ * Sleep until the next timer deadline or any other interrupt
+ *
+ * @par Implementation Notes:
+ * Timer2 runs from the I/O clock, which only keeps running in idle mode, so
+ * idle is the deepest mode that keeps time. The saving comes from the
+ * length of the sleep instead: the timer is switched to its /1024 prescaler,
+ * so one compare can cover many ticks (up to 16 ms at 16 MHz).
+ *
+ * Time is carried across the switch in tick-rate counts. On wake, whole
+ * ticks are added to _ticks and the remainder is loaded back into the
+ * counter, so the tick phase is kept. Both switches are made on a count edge
+ * so no partial count is lost. When another interrupt ends the sleep, that
+ * means waiting up to one /1024 count (64 us at 16 MHz) before returning.
+ *
+ * While stretched, _ticks is not updated, so an ISR that reads the clock
+ * sees the time the sleep started.
+ */
+uint16_t
+clock::idle(bool (*busy)()) {
+    cli();
+
+    if (busy && busy()) {
+        sei();
+        return 0;
+    }
+
+    uint32_t now = _ticks;
+    uint32_t left = ticks_to_deadline(now);
+
+    // Far more than one stretched period can cover
+    if (left > 255) {
+        left = 255;
+    }
+
+    // Start on a count edge, so resetting the prescaler loses nothing
+    uint8_t count = __CNT_REG;
+    if (left >= 2) {
+        while (__CNT_REG == count) {
+        }
+        count = __CNT_REG;
+    }
+
+    // A tick is about to be counted, or the deadline is too close to stretch
+    uint32_t target = (left < 2) ? 0 : left * OCR_VALUE - count;
+    if (target < 2 * SLOW_RATIO || (__INT_FLG_REG & __INT_FLG_MASK)) {
+        if (left != 0) {
+            sleep_once();
+        }
+        sei();
+        return 0;
+    }
+
+    uint16_t slow = target / SLOW_RATIO;
+    if (slow > 256) {
+        slow = 256;
+    }
+
+    // Restart the timer at /1024, counting to the deadline
+    __PRESCALE_REG &= ~(__PRESCALE_BIT(2) | __PRESCALE_BIT(1) |
+                        __PRESCALE_BIT(0));
+    __CNT_REG = 0;
+    __OCR_REG = slow - 1;
+    __INT_FLG_REG = __INT_FLG_MASK;
+    _stretch_expired = false;
+    _stretched = true;
+    __PRESCALE_RESET();
+    __PRESCALE_REG |= PRESCALE_SLOW;
+
+    sleep_once();
+
+    // Woken by something else: finish the current count rather than lose it
+    if (!_stretch_expired) {
+        uint8_t partial = __CNT_REG;
+        while (__CNT_REG == partial &&
+               (__INT_FLG_REG & __INT_FLG_MASK) == 0) {
+        }
+    }
+
+    __PRESCALE_REG &= ~PRESCALE_SLOW;
+    uint16_t elapsed = __CNT_REG;
+    if (__INT_FLG_REG & __INT_FLG_MASK) {
+        // Ran out after the wake, before the ISR could run
+        __INT_FLG_REG = __INT_FLG_MASK;
+        elapsed = slow;
+    } else if (_stretch_expired) {
+        elapsed += slow;
+    }
+    _stretched = false;
+
+    // Back to the tick rate, keeping the phase within the tick
+    uint32_t counts = count + static_cast<uint32_t>(elapsed) * SLOW_RATIO;
+    uint16_t slept = counts / OCR_VALUE;
+    now += slept;
+    _ticks = now;
+
+    __CNT_REG = counts % OCR_VALUE;
+    __OCR_REG = OCR_VALUE - 1;
+    __PRESCALE_RESET();
+    __PRESCALE_REG |= prescale_reg_val();
+
+#ifndef CLOCK_NO_TIMERS
+    // Catch up on every slot the skipped ticks would have visited
+    uint8_t sweep = slept < WHEEL_SLOTS ? slept : WHEEL_SLOTS;
+    for (uint8_t i = 0; i < sweep; ++i) {
+        uint8_t slot = (now - i) & WHEEL_MASK;
+        if (_wheel[slot]) {
+            expire_slot(slot, now);
+        }
+    }
+#endif
+
+    sei();
+    return slept;
+}
+
+#else
+
+/**
+ * Sleep until the next interrupt
+ *
+ * @par Implementation Notes:
+ * The tick timer is shared with other timers on this target, so it is
+ * not stretched. The CPU still sleeps between ticks.
+ */
+uint16_t
+clock::idle(bool (*busy)()) {
+    cli();
+    if (busy == nullptr || !busy()) {
+        uint8_t mode = get_sleep_mode();
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        cli();
+        sleep_disable();
+        restore_sleep_mode(mode);
+    }
+    sei();
+    return 0;
+}
+
+#endif
+
+
 ISR(__INT_VECT) {
-    _ticks += 1;
+#if defined(__PRESCALE_RESET)
+    if (_stretched) {
+        _stretch_expired = true;
+        return;
+    }
+#endif
+
+    uint32_t now = _ticks + 1;
+    _ticks = now;
+
+#ifndef CLOCK_NO_TIMERS
+    if (_wheel[now & WHEEL_MASK]) {
+        expire_slot(now & WHEEL_MASK, now);
+    }
+#endif
     // Flag is automatically cleared for us
 }
 
@@ -22,6 +22,7 @@
 
 #include <savr/crc.h>
 #include <savr/optimized.h>
+#include <savr/prof.h>
 
 /**
  * CRC-8
@@ -186,6 +187,7 @@ crc_8_rev_both(const uint8_t *data, size_t length, uint8_t crc, uint8_t poly) {
  */
 uint16_t
 crc_16(const uint8_t *data, size_t length, uint16_t crc, uint16_t poly) {
+    SAVR_PROFILE("crc::crc_16");
     return _crc_16(data, length, crc, poly);
 }
 
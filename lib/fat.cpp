@@ -0,0 +1,889 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file fat.cpp
+ *
+ * FAT16/FAT32 files on the SD card
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/fat.h>
+#include <savr/sd.h>
+
+using namespace savr;
+using fat::Result;
+
+namespace {
+
+constexpr uint16_t BLOCK_SIZE = 512;
+
+// Boot sector (BPB) fields
+constexpr uint16_t BPB_BYTES_PER_SECTOR = 11;
+constexpr uint16_t BPB_SECTORS_PER_CLUSTER = 13;
+constexpr uint16_t BPB_RESERVED_SECTORS = 14;
+constexpr uint16_t BPB_FATS = 16;
+constexpr uint16_t BPB_ROOT_ENTRIES = 17;
+constexpr uint16_t BPB_TOTAL_SECTORS_16 = 19;
+constexpr uint16_t BPB_FAT_SIZE_16 = 22;
+constexpr uint16_t BPB_TOTAL_SECTORS_32 = 32;
+constexpr uint16_t BPB_FAT_SIZE_32 = 36;
+constexpr uint16_t BPB_ROOT_CLUSTER = 44;
+constexpr uint16_t BPB_FSINFO = 48;
+constexpr uint16_t SIGNATURE = 510;
+
+// MBR partition table
+constexpr uint16_t MBR_PARTITIONS = 446;
+constexpr uint8_t MBR_ENTRY_SIZE = 16;
+constexpr uint8_t MBR_TYPE = 4;
+constexpr uint8_t MBR_START = 8;
+
+// FAT32 FSInfo sector
+constexpr uint32_t FSINFO_LEAD = 0x41615252;
+constexpr uint16_t FSINFO_FREE_COUNT = 488;
+constexpr uint16_t FSINFO_NEXT_FREE = 492;
+
+// Directory entries
+constexpr uint8_t DIR_ENTRY_SIZE = 32;
+constexpr uint8_t DIR_ENTRIES = BLOCK_SIZE / DIR_ENTRY_SIZE;
+constexpr uint8_t DIR_NAME_SIZE = 11;
+constexpr uint8_t DIR_ATTR = 11;
+constexpr uint8_t DIR_CLUSTER_HI = 20;
+constexpr uint8_t DIR_CLUSTER_LO = 26;
+constexpr uint8_t DIR_SIZE = 28;
+
+constexpr uint8_t ENTRY_END = 0x00;
+constexpr uint8_t ENTRY_FREE = 0xE5;
+
+constexpr uint8_t ATTR_READ_ONLY = 0x01;
+constexpr uint8_t ATTR_VOLUME = 0x08;   // Also set on long name entries
+constexpr uint8_t ATTR_DIRECTORY = 0x10;
+constexpr uint8_t ATTR_ARCHIVE = 0x20;
+
+//! The mounted volume
+typedef struct {
+    uint32_t fat_start;     ///< First block of the first FAT
+    uint32_t fat_size;      ///< Blocks per FAT
+    uint32_t data_start;    ///< Block of cluster 2
+    uint32_t clusters;      ///< Highest cluster number + 1
+    uint32_t root;          ///< FAT16: first root block, FAT32: root cluster
+    uint32_t free_hint;     ///< Where to start looking for a free cluster
+    uint32_t fsinfo;        ///< FSInfo block to mark stale, 0 if none
+    uint16_t root_blocks;   ///< FAT16 root directory size
+    uint8_t fats;           ///< Number of FAT copies
+    uint8_t cluster_shift;  ///< log2 of blocks per cluster
+    uint8_t type;           ///< 16 or 32, 0 if not mounted
+} Volume;
+
+//! Position while walking a directory
+typedef struct {
+    uint32_t cluster;       ///< Current cluster, 0 for the FAT16 root
+    uint32_t block;         ///< Current block
+    uint16_t left;          ///< Blocks left in the cluster (or FAT16 root)
+} Dir;
+
+Volume _vol;
+
+
+uint16_t
+ld16(const uint8_t *p) {
+    return p[0] | (uint16_t) p[1] << 8;
+}
+
+
+uint32_t
+ld32(const uint8_t *p) {
+    return ld16(p) | (uint32_t) ld16(p + 2) << 16;
+}
+
+
+void
+st16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+}
+
+
+void
+st32(uint8_t *p, uint32_t value) {
+    st16(p, (uint16_t) value);
+    st16(p + 2, (uint16_t) (value >> 16));
+}
+
+
+uint32_t
+cluster_block(uint32_t cluster) {
+    return _vol.data_start + ((cluster - 2) << _vol.cluster_shift);
+}
+
+
+uint32_t
+cluster_bytes() {
+    return (uint32_t) BLOCK_SIZE << _vol.cluster_shift;
+}
+
+
+bool
+end_of_chain(uint32_t value) {
+    return value >= (_vol.type == 32 ? 0x0FFFFFF8uL : 0xFFF8uL);
+}
+
+
+/**
+ * Checks that a value names a data cluster on the volume
+ */
+bool
+valid_cluster(uint32_t cluster) {
+    return cluster >= 2 && cluster < _vol.clusters;
+}
+
+
+uint32_t
+entry_cluster(const uint8_t *entry) {
+    uint32_t cluster = ld16(entry + DIR_CLUSTER_LO);
+    if (_vol.type == 32) {
+        cluster |= (uint32_t) ld16(entry + DIR_CLUSTER_HI) << 16;
+    }
+    return cluster;
+}
+
+
+/**
+ * Reads a FAT entry
+ */
+Result
+fat_get(uint32_t cluster, uint32_t &value) {
+    uint32_t offset = cluster * (_vol.type / 8);
+    uint8_t *p;
+
+    if (!valid_cluster(cluster)) {
+        return fat::ERR_CORRUPT;
+    }
+
+    p = sd::cache_block(_vol.fat_start + offset / BLOCK_SIZE);
+    if (!p) {
+        return fat::ERR_IO;
+    }
+    p += offset % BLOCK_SIZE;
+
+    value = _vol.type == 32 ? ld32(p) & 0x0FFFFFFF : ld16(p);
+    return fat::OK;
+}
+
+
+/**
+ * Follows a cluster chain one link
+ *
+ * @return OK, with next either a data cluster or an end of chain mark, or
+ *         ERR_CORRUPT if the link is free, reserved or off the volume
+ */
+Result
+fat_next(uint32_t cluster, uint32_t &next) {
+    Result res = fat_get(cluster, next);
+    if (!res && !end_of_chain(next) && !valid_cluster(next)) {
+        return fat::ERR_CORRUPT;
+    }
+    return res;
+}
+
+
+/**
+ * Writes a FAT entry, in every copy of the FAT
+ */
+Result
+fat_set(uint32_t cluster, uint32_t value) {
+    uint32_t offset = cluster * (_vol.type / 8);
+    uint32_t block = _vol.fat_start + offset / BLOCK_SIZE;
+    uint8_t *p;
+
+    for (uint8_t i = 0; i < _vol.fats; i++, block += _vol.fat_size) {
+        p = sd::cache_block(block, true);
+        if (!p) {
+            return fat::ERR_IO;
+        }
+        p += offset % BLOCK_SIZE;
+
+        if (_vol.type == 32) {
+            // The top four bits are reserved, and kept
+            st32(p, (ld32(p) & 0xF0000000) | value);
+        } else {
+            st16(p, (uint16_t) value);
+        }
+    }
+    return fat::OK;
+}
+
+
+/**
+ * Takes a free cluster, and links it after prev (unless 0)
+ *
+ * @par Implementation Notes:
+ * The search starts where the last one left off, so a growing file gets
+ * its clusters one after the other in a single pass over the FAT. The
+ * FAT32 free count is marked unknown on the first allocation, rather than
+ * being kept up to date.
+ */
+Result
+alloc(uint32_t prev, uint32_t &cluster) {
+    uint32_t value;
+    uint32_t c = _vol.free_hint;
+    Result res;
+
+    do {
+        res = fat_get(c, value);
+        if (res) {
+            return res;
+        }
+
+        if (value == 0) {
+            res = fat_set(c, 0x0FFFFFFF);
+            if (!res && prev) {
+                res = fat_set(prev, c);
+            }
+            if (res) {
+                return res;
+            }
+
+            if (_vol.fsinfo) {
+                uint8_t *p = sd::cache_block(_vol.fsinfo, true);
+                if (!p) {
+                    return fat::ERR_IO;
+                }
+                st32(p + FSINFO_FREE_COUNT, 0xFFFFFFFF);
+                st32(p + FSINFO_NEXT_FREE, 0xFFFFFFFF);
+                _vol.fsinfo = 0;
+            }
+
+            _vol.free_hint = c + 1 < _vol.clusters ? c + 1 : 2;
+            cluster = c;
+            return fat::OK;
+        }
+
+        if (++c >= _vol.clusters) {
+            c = 2;
+        }
+    } while (c != _vol.free_hint);
+
+    return fat::ERR_FULL;
+}
+
+
+void
+dir_open(Dir &dir, uint32_t cluster) {
+    if (!cluster && _vol.type == 16) {
+        dir.cluster = 0;
+        dir.block = _vol.root;
+        dir.left = _vol.root_blocks;
+        return;
+    }
+
+    if (!cluster) {
+        cluster = _vol.root;
+    }
+    dir.cluster = cluster;
+    dir.block = cluster_block(cluster);
+    dir.left = 1 << _vol.cluster_shift;
+}
+
+
+/**
+ * Moves to the next block of a directory
+ *
+ * @param extend    add a cleared cluster at the end of the directory
+ *
+ * @return OK, or ERR_NOT_FOUND at the end of the directory
+ */
+Result
+dir_next(Dir &dir, bool extend) {
+    uint32_t next;
+    Result res;
+
+    if (--dir.left) {
+        dir.block++;
+        return fat::OK;
+    }
+
+    if (!dir.cluster) {
+        // The FAT16 root can't grow
+        return extend ? fat::ERR_FULL : fat::ERR_NOT_FOUND;
+    }
+
+    res = fat_next(dir.cluster, next);
+    if (res) {
+        return res;
+    }
+
+    if (end_of_chain(next)) {
+        if (!extend) {
+            return fat::ERR_NOT_FOUND;
+        }
+
+        res = alloc(dir.cluster, next);
+        if (res) {
+            return res;
+        }
+
+        uint32_t block = cluster_block(next);
+        for (uint16_t i = 0; i < (1 << _vol.cluster_shift); i++) {
+            uint8_t *p = sd::cache_new(block + i);
+            if (!p) {
+                return fat::ERR_IO;
+            }
+            memset(p, 0, BLOCK_SIZE);
+        }
+    }
+
+    dir_open(dir, next);
+    return fat::OK;
+}
+
+
+/**
+ * Converts the first component of a path to a directory entry name
+ *
+ * @param path  the path
+ * @param name  set to the space-padded 8.3 name
+ *
+ * @return the rest of the path, or NULL if the component is not valid
+ */
+const char *
+to_name(const char *path, uint8_t *name) {
+    uint8_t i = 0;
+    uint8_t limit = 8;
+
+    memset(name, ' ', DIR_NAME_SIZE);
+
+    for (; *path && *path != '/'; path++) {
+        char c = *path;
+
+        if (c == '.') {
+            if (!i || limit == DIR_NAME_SIZE) {
+                return NULL;
+            }
+            i = 8;
+            limit = DIR_NAME_SIZE;
+            continue;
+        }
+
+        if (i >= limit || c <= ' ' || strchr_P(PSTR("\"*+,./:;<=>?[\\]|"), c)) {
+            return NULL;
+        }
+        name[i++] = toupper(c);
+    }
+
+    if (!i) {
+        return NULL;
+    }
+    if (*path == '/') {
+        path++;
+    }
+    return path;
+}
+
+
+/**
+ * Looks for a name in a directory
+ *
+ * @param dir       first cluster of the directory, 0 for the root
+ * @param name      the 8.3 name
+ * @param create    make sure there is a free entry, if not found
+ * @param block     set to the entry's block, or a free entry's
+ * @param index     set to the entry's index, or a free entry's
+ *
+ * @return OK if found, ERR_NOT_FOUND if not
+ */
+Result
+lookup(uint32_t dir, const uint8_t *name, bool create, uint32_t &block,
+       uint8_t &index) {
+    Dir d;
+    bool have_free = false;
+    Result res;
+
+    dir_open(d, dir);
+    for (;;) {
+        uint8_t *p = sd::cache_block(d.block);
+        if (!p) {
+            return fat::ERR_IO;
+        }
+
+        for (uint8_t i = 0; i < DIR_ENTRIES; i++, p += DIR_ENTRY_SIZE) {
+            if (p[0] == ENTRY_END || p[0] == ENTRY_FREE) {
+                if (!have_free) {
+                    have_free = true;
+                    block = d.block;
+                    index = i;
+                }
+                if (p[0] == ENTRY_END) {
+                    return fat::ERR_NOT_FOUND;
+                }
+            } else if (!(p[DIR_ATTR] & ATTR_VOLUME) &&
+                       memcmp(p, name, DIR_NAME_SIZE) == 0) {
+                block = d.block;
+                index = i;
+                return fat::OK;
+            }
+        }
+
+        res = dir_next(d, create && !have_free);
+        if (res) {
+            return res;
+        }
+    }
+}
+
+
+/**
+ * Finds the cluster holding the file position, growing the file if asked
+ *
+ * @par Implementation Notes:
+ * Carries on from the cluster found last time, so sequential access follows
+ * one link per cluster. Only a seek backwards starts again from the first
+ * cluster.
+ */
+Result
+locate(fat::File &file, bool grow) {
+    uint32_t bytes = cluster_bytes();
+    uint32_t next;
+    Result res;
+
+    if (!file.first) {
+        if (!grow) {
+            return fat::ERR_CORRUPT;
+        }
+        res = alloc(0, file.first);
+        if (res) {
+            return res;
+        }
+        file.dirty = true;
+    }
+
+    if (!file.cluster || file.pos < file.cluster_pos) {
+        file.cluster = file.first;
+        file.cluster_pos = 0;
+    }
+
+    while (file.pos - file.cluster_pos >= bytes) {
+        res = fat_next(file.cluster, next);
+        if (res) {
+            return res;
+        }
+
+        if (end_of_chain(next)) {
+            if (!grow) {
+                return fat::ERR_CORRUPT;
+            }
+            res = alloc(file.cluster, next);
+            if (res) {
+                return res;
+            }
+        }
+
+        file.cluster = next;
+        file.cluster_pos += bytes;
+    }
+
+    return fat::OK;
+}
+
+
+/**
+ * Checks for a FAT boot sector
+ */
+bool
+is_boot(const uint8_t *p) {
+    uint8_t spc = p[BPB_SECTORS_PER_CLUSTER];
+
+    return ld16(p + BPB_BYTES_PER_SECTOR) == BLOCK_SIZE &&
+           spc && !(spc & (spc - 1)) &&
+           ld16(p + BPB_RESERVED_SECTORS) &&
+           (p[BPB_FATS] == 1 || p[BPB_FATS] == 2) &&
+           ld16(p + SIGNATURE) == 0xAA55;
+}
+
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The FAT type comes from the cluster count, as the specification says,
+ * not from the type string in the boot sector.
+ */
+Result
+fat::mount() {
+    uint32_t start = 0;
+    uint32_t total;
+    uint32_t count;
+    uint8_t *p;
+    uint8_t i;
+
+    _vol.type = 0;
+    sd::cache_invalidate();
+
+    p = sd::cache_block(0);
+    if (!p) {
+        return ERR_IO;
+    }
+
+    if (!is_boot(p)) {
+        if (ld16(p + SIGNATURE) != 0xAA55) {
+            return ERR_NO_FS;
+        }
+
+        // Partitioned: take the first FAT16/FAT32 partition
+        for (i = 0; i < 4; i++) {
+            const uint8_t *e = p + MBR_PARTITIONS + i * MBR_ENTRY_SIZE;
+            uint8_t type = e[MBR_TYPE];
+            if (type == 0x04 || type == 0x06 || type == 0x0E ||
+                type == 0x0B || type == 0x0C) {
+                start = ld32(e + MBR_START);
+                break;
+            }
+        }
+        if (i == 4) {
+            return ERR_NO_FS;
+        }
+
+        p = sd::cache_block(start);
+        if (!p) {
+            return ERR_IO;
+        }
+        if (!is_boot(p)) {
+            return ERR_NO_FS;
+        }
+    }
+
+    _vol.cluster_shift = 0;
+    while ((1 << _vol.cluster_shift) < p[BPB_SECTORS_PER_CLUSTER]) {
+        _vol.cluster_shift++;
+    }
+
+    _vol.fats = p[BPB_FATS];
+    _vol.fat_start = start + ld16(p + BPB_RESERVED_SECTORS);
+    _vol.fat_size = ld16(p + BPB_FAT_SIZE_16);
+    if (!_vol.fat_size) {
+        _vol.fat_size = ld32(p + BPB_FAT_SIZE_32);
+    }
+    total = ld16(p + BPB_TOTAL_SECTORS_16);
+    if (!total) {
+        total = ld32(p + BPB_TOTAL_SECTORS_32);
+    }
+
+    _vol.root_blocks = (ld16(p + BPB_ROOT_ENTRIES) * DIR_ENTRY_SIZE +
+                        BLOCK_SIZE - 1) / BLOCK_SIZE;
+    _vol.data_start = _vol.fat_start + _vol.fats * _vol.fat_size +
+                      _vol.root_blocks;
+
+    if (_vol.data_start - start >= total) {
+        return ERR_NO_FS;
+    }
+    count = (total - (_vol.data_start - start)) >> _vol.cluster_shift;
+    if (count < 4085) {
+        // FAT12
+        return ERR_NO_FS;
+    }
+    _vol.clusters = count + 2;
+    _vol.free_hint = 2;
+    _vol.fsinfo = 0;
+
+    if (count < 65525) {
+        if (_vol.fat_size * (BLOCK_SIZE / 2) < _vol.clusters) {
+            return ERR_NO_FS;
+        }
+        _vol.type = 16;
+        _vol.root = _vol.fat_start + _vol.fats * _vol.fat_size;
+        return OK;
+    }
+
+    // Every cluster needs a FAT entry, and the root must be a cluster
+    _vol.root = ld32(p + BPB_ROOT_CLUSTER);
+    if (_vol.fat_size * (BLOCK_SIZE / 4) < _vol.clusters ||
+        !valid_cluster(_vol.root)) {
+        return ERR_NO_FS;
+    }
+    uint16_t fsinfo = ld16(p + BPB_FSINFO);
+
+    // Start allocating where the FSInfo hint says
+    if (fsinfo && fsinfo != 0xFFFF) {
+        p = sd::cache_block(start + fsinfo);
+        if (!p) {
+            return ERR_IO;
+        }
+        if (ld32(p) == FSINFO_LEAD) {
+            uint32_t next = ld32(p + FSINFO_NEXT_FREE);
+            if (next >= 2 && next < _vol.clusters) {
+                _vol.free_hint = next;
+            }
+            _vol.fsinfo = start + fsinfo;
+        }
+    }
+
+    _vol.type = 32;
+    return OK;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+Result
+fat::open(File &file, const char *path, uint8_t mode) {
+    uint8_t name[DIR_NAME_SIZE];
+    uint32_t dir = 0;
+    uint32_t block = 0;
+    uint8_t index = 0;
+    uint8_t *p;
+    Result res;
+
+    file.mode = 0;
+    if (!_vol.type) {
+        return ERR_NO_FS;
+    }
+
+    if (*path == '/') {
+        path++;
+    }
+
+    for (;;) {
+        path = to_name(path, name);
+        if (!path) {
+            return ERR_BAD_NAME;
+        }
+
+        bool last = !*path;
+        bool create = last && (mode & CREATE);
+
+        res = lookup(dir, name, create, block, index);
+        if (res == ERR_NOT_FOUND && create) {
+            p = sd::cache_block(block, true);
+            if (!p) {
+                return ERR_IO;
+            }
+            p += index * DIR_ENTRY_SIZE;
+            memset(p, 0, DIR_ENTRY_SIZE);
+            memcpy(p, name, DIR_NAME_SIZE);
+            p[DIR_ATTR] = ATTR_ARCHIVE;
+            break;
+        }
+        if (res) {
+            return res;
+        }
+
+        p = sd::cache_block(block);
+        if (!p) {
+            return ERR_IO;
+        }
+        p += index * DIR_ENTRY_SIZE;
+
+        if (last) {
+            break;
+        }
+        if (!(p[DIR_ATTR] & ATTR_DIRECTORY)) {
+            return ERR_NOT_FOUND;
+        }
+        dir = entry_cluster(p);
+        if (dir && !valid_cluster(dir)) {
+            return ERR_CORRUPT;
+        }
+    }
+
+    if ((p[DIR_ATTR] & ATTR_DIRECTORY) ||
+        ((mode & WRITE) && (p[DIR_ATTR] & ATTR_READ_ONLY))) {
+        return ERR_DENIED;
+    }
+
+    file.size = ld32(p + DIR_SIZE);
+    file.first = entry_cluster(p);
+    if (file.first && !valid_cluster(file.first)) {
+        return ERR_CORRUPT;
+    }
+    file.pos = 0;
+    file.cluster = 0;
+    file.cluster_pos = 0;
+    file.dir_block = block;
+    file.dir_index = index;
+    file.mode = mode;
+    file.dirty = false;
+    return OK;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+Result
+fat::read(File &file, void *buf, size_t length, size_t &done) {
+    uint8_t *p;
+    Result res;
+
+    done = 0;
+    if (!(file.mode & READ)) {
+        return ERR_DENIED;
+    }
+
+    if (length > file.size - file.pos) {
+        length = file.size - file.pos;
+    }
+
+    while (done < length) {
+        res = locate(file, false);
+        if (res) {
+            return res;
+        }
+
+        uint16_t offset = file.pos % BLOCK_SIZE;
+        size_t n = BLOCK_SIZE - offset;
+        if (n > length - done) {
+            n = length - done;
+        }
+
+        p = sd::cache_block(cluster_block(file.cluster) +
+                            (file.pos - file.cluster_pos) / BLOCK_SIZE);
+        if (!p) {
+            return ERR_IO;
+        }
+        memcpy((uint8_t *) buf + done, p + offset, n);
+
+        file.pos += n;
+        done += n;
+    }
+
+    return OK;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * A block that is written whole, or that holds nothing of the file yet,
+ * is not read from the card first.
+ */
+Result
+fat::write(File &file, const void *buf, size_t length, size_t &done) {
+    uint8_t *p;
+    Result res;
+
+    done = 0;
+    if (!(file.mode & WRITE)) {
+        return ERR_DENIED;
+    }
+
+    if (file.mode & APPEND) {
+        file.pos = file.size;
+    }
+
+    while (done < length) {
+        res = locate(file, true);
+        if (res) {
+            return res;
+        }
+
+        uint16_t offset = file.pos % BLOCK_SIZE;
+        size_t n = BLOCK_SIZE - offset;
+        if (n > length - done) {
+            n = length - done;
+        }
+
+        uint32_t block = cluster_block(file.cluster) +
+                         (file.pos - file.cluster_pos) / BLOCK_SIZE;
+        if (n == BLOCK_SIZE) {
+            p = sd::cache_new(block);
+        } else if (file.pos - offset >= file.size) {
+            p = sd::cache_new(block);
+            if (p) {
+                memset(p, 0, BLOCK_SIZE);
+            }
+        } else {
+            p = sd::cache_block(block, true);
+        }
+        if (!p) {
+            return ERR_IO;
+        }
+        memcpy(p + offset, (const uint8_t *) buf + done, n);
+
+        file.pos += n;
+        done += n;
+        if (file.pos > file.size) {
+            file.size = file.pos;
+            file.dirty = true;
+        }
+    }
+
+    return OK;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The cluster is found lazily, by the next read() or write().
+ */
+Result
+fat::seek(File &file, uint32_t pos) {
+    if (!file.mode) {
+        return ERR_DENIED;
+    }
+
+    file.pos = pos < file.size ? pos : file.size;
+    return OK;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+Result
+fat::sync(File &file) {
+    uint8_t *p;
+
+    if (!file.mode) {
+        return ERR_DENIED;
+    }
+
+    if (file.dirty) {
+        p = sd::cache_block(file.dir_block, true);
+        if (!p) {
+            return ERR_IO;
+        }
+        p += file.dir_index * DIR_ENTRY_SIZE;
+
+        st16(p + DIR_CLUSTER_HI, (uint16_t) (file.first >> 16));
+        st16(p + DIR_CLUSTER_LO, (uint16_t) file.first);
+        st32(p + DIR_SIZE, file.size);
+        p[DIR_ATTR] |= ATTR_ARCHIVE;
+        file.dirty = false;
+    }
+
+    return sd::flush() ? OK : ERR_IO;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+Result
+fat::close(File &file) {
+    Result res = sync(file);
+    file.mode = 0;
+    return res;
+}
@@ -0,0 +1,296 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file frame.cpp
+ *
+ * COBS + CRC-16 framing over the SCI
+ */
+
+#include <string.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+#include <savr/frame.h>
+#include <savr/crc.h>
+#include <savr/utils.h>
+
+#if !defined(SAVR_NO_SCI)
+
+using namespace savr;
+
+namespace {
+
+constexpr uint8_t  SLOTS      = FRAME_SLOTS;
+constexpr uint8_t  SLOT_MASK  = SLOTS - 1;
+constexpr uint8_t  SLOT_SIZE  = frame::MAX_PAYLOAD + 2;
+constexpr uint16_t CRC_POLY   = 0x1021;
+constexpr uint16_t CRC_INIT   = 0xFFFF;
+
+static_assert(SLOTS > 0 && (SLOTS & SLOT_MASK) == 0,
+              "FRAME_SLOTS must be a power of two");
+static_assert(SLOTS <= 128, "FRAME_SLOTS too large");
+
+/// Worst-case encoded size: payload + CRC, one code byte per 254 bytes,
+/// plus both delimiters
+constexpr size_t TX_SIZE = SLOT_SIZE + SLOT_SIZE / 254 + 1 + 2;
+
+typedef struct {
+    uint8_t data[SLOT_SIZE];
+    uint8_t length;
+    bool    valid;          ///< CRC matched, set when the slot is closed
+} Slot;
+
+Slot _slots[SLOTS];
+volatile uint8_t _head = 0;    ///< Next slot the ISR fills, owned by the ISR
+volatile uint8_t _tail = 0;    ///< Oldest completed slot, owned by main
+
+/// Decoder state, ISR only
+uint8_t _pos       = 0;     ///< Bytes decoded into the current slot
+uint8_t _remaining = 0;     ///< Bytes left in the current COBS block
+uint8_t _code      = 0xFF;  ///< Code byte of the current block
+bool    _discard   = true;  ///< Drop everything up to the next delimiter
+uint16_t _crc      = CRC_INIT;  ///< Running CRC of the bytes decoded so far
+
+frame::Stats _stats = {};
+
+size_t (*_write)(const void *, size_t) = nullptr;
+
+uint8_t _tx_buffer[TX_SIZE];
+volatile bool _tx_busy = false;     ///< A send() owns _tx_buffer
+
+}
+
+
+void
+frame::attach(size_t (*write)(const void *, size_t)) {
+    _write = write;
+}
+
+
+/**
+ * Decode one received byte
+ *
+ * @par Implementation Notes:
+ * A zero byte always ends the current frame. A COBS block with code < 0xFF
+ * implies a zero after it unless it is the last block; that zero is written
+ * when the next block starts, so the frame never ends with a spurious one.
+ * Frames that arrive while every slot is full are discarded whole.
+ *
+ * The CRC is updated as each byte is decoded, so closing a slot only has to
+ * test it. A frame's CRC, appended big-endian, leaves a zero remainder.
+ */
+void
+frame::rx_byte(uint8_t data) {
+    if (data == 0) {
+        if (!_discard && _pos != 0) {
+            if (_remaining != 0 || _pos < 2) {
+                _stats.bad_frames++;
+            } else {
+                uint8_t head = _head;
+                Slot &slot = _slots[head & SLOT_MASK];
+                slot.length = _pos;
+                slot.valid  = (_crc == 0);
+                _stats.frames++;
+                if (!slot.valid) {
+                    _stats.crc_errors++;
+                }
+                COMPILER_BARRIER();
+                _head = head + 1;
+            }
+        }
+        _pos       = 0;
+        _remaining = 0;
+        _code      = 0xFF;
+        _discard   = false;
+        _crc       = CRC_INIT;
+        return;
+    }
+
+    if (_discard) {
+        return;
+    }
+
+    if (_pos == 0 && _remaining == 0 && _code == 0xFF) {
+        // First byte of a new frame
+        if ((uint8_t)(_head - _tail) >= SLOTS) {
+            _stats.overflows++;
+            _discard = true;
+            return;
+        }
+    }
+
+    uint8_t *slot = _slots[_head & SLOT_MASK].data;
+
+    if (_remaining == 0) {
+        // A new code byte. The previous block implied a zero if short.
+        if (_code != 0xFF) {
+            if (_pos >= SLOT_SIZE) {
+                goto too_long;
+            }
+            slot[_pos++] = 0;
+            _crc = _crc_xmodem_update(_crc, 0);
+        }
+        _code      = data;
+        _remaining = data - 1;
+        return;
+    }
+
+    if (_pos >= SLOT_SIZE) {
+        goto too_long;
+    }
+    slot[_pos++] = data;
+    _crc = _crc_xmodem_update(_crc, data);
+    _remaining--;
+    return;
+
+too_long:
+    _stats.bad_frames++;
+    _discard = true;
+}
+
+
+/**
+ * Get the oldest received frame
+ *
+ * @par Implementation Notes:
+ * The CRC was checked by the ISR when the slot was closed. Slots marked
+ * invalid are released here.
+ */
+const uint8_t *
+frame::peek(size_t &length) {
+    while (_tail != _head) {
+        COMPILER_BARRIER();
+        Slot &slot = _slots[_tail & SLOT_MASK];
+
+        if (slot.valid) {
+            length = slot.length - 2;
+            return slot.data;
+        }
+        release();
+    }
+    return nullptr;
+}
+
+
+void
+frame::release() {
+    if (_tail != _head) {
+        COMPILER_BARRIER();
+        _tail = _tail + 1;
+    }
+}
+
+
+size_t
+frame::receive(void *dst, size_t length) {
+    size_t frame_length;
+    const uint8_t *payload = peek(frame_length);
+    if (payload == nullptr) {
+        return 0;
+    }
+
+    if (length > frame_length) {
+        length = frame_length;
+    }
+    memcpy(dst, payload, length);
+    release();
+    return frame_length;
+}
+
+
+/**
+ * Send a frame
+ *
+ * @par Implementation Notes:
+ * The whole frame is encoded into a static buffer first, then pushed out
+ * through the USART's non-blocking write until it has all been queued.
+ * With interrupts disabled the transmit buffer can't drain, so a full buffer
+ * ends the send instead of waiting on it forever. The buffer is shared, so a
+ * send() from an ISR that interrupted another one is turned away.
+ */
+bool
+frame::send(const void *payload, size_t length) {
+    if (length > MAX_PAYLOAD || _write == nullptr) {
+        return false;
+    }
+
+    bool busy;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        busy = _tx_busy;
+        _tx_busy = true;
+    }
+    if (busy) {
+        return false;
+    }
+
+    const uint8_t *src = static_cast<const uint8_t *>(payload);
+    uint16_t crc = crc::crc_16(src, length, CRC_INIT, CRC_POLY);
+    uint8_t trailer[2] = {(uint8_t)(crc >> 8), (uint8_t)crc};
+
+    uint8_t *out  = _tx_buffer;
+    *out++ = 0;
+    uint8_t *code = out++;
+    uint8_t count = 1;
+
+    for (size_t i = 0; i < length + 2; ++i) {
+        uint8_t byte = (i < length) ? src[i] : trailer[i - length];
+        if (byte == 0) {
+            *code = count;
+            code  = out++;
+            count = 1;
+            continue;
+        }
+        *out++ = byte;
+        if (++count == 0xFF) {
+            *code = count;
+            code  = out++;
+            count = 1;
+        }
+    }
+    *code  = count;
+    *out++ = 0;
+
+    const uint8_t *pos = _tx_buffer;
+    size_t left = out - _tx_buffer;
+    while (left) {
+        size_t sent = _write(pos, left);
+        if (sent == 0 && (SREG & _BV(SREG_I)) == 0) {
+            break;
+        }
+        pos  += sent;
+        left -= sent;
+    }
+
+    _tx_busy = false;
+    return left == 0;
+}
+
+
+void
+frame::get_stats(Stats &stats) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        stats = _stats;
+    }
+}
+
+#endif
@@ -0,0 +1,268 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file mspim.cpp
+ *
+ * SPI master on a USART
+ */
+
+#include <avr/io.h>
+
+#include <savr/gpio.h>
+#include <savr/mspim.h>
+#include <savr/sci_defs.h>
+#include <savr/utils.h>
+
+#if !defined(SAVR_NO_SCI) && defined(UMSEL01)
+
+using namespace savr;
+
+namespace {
+
+/**
+ * XCK (the SPI clock) pin of USART N
+ */
+template<uint8_t N>
+struct Xck;
+
+#if     ISAVR(ATmega48)     || ISAVR(ATmega88)      || ISAVR(ATmega168)     || \
+        ISAVR(ATmega48P)    || ISAVR(ATmega88P)     || ISAVR(ATmega168P)    || \
+        ISAVR(ATmega48PA)   || ISAVR(ATmega88PA)    || ISAVR(ATmega168PA)   || ISAVR(ATmega328P)
+template<> struct Xck<0> { static constexpr gpio::Pin pin = gpio::D4; };
+#else
+template<> struct Xck<0> { static constexpr gpio::Pin pin = gpio::B0; };
+template<> struct Xck<1> { static constexpr gpio::Pin pin = gpio::D4; };
+#endif
+
+
+// UCSRnC in MSPIM mode. The bits sit in the same place on every USART.
+constexpr uint8_t CTRLC_MSPIM = _BV(UMSEL01) | _BV(UMSEL00);
+constexpr uint8_t CTRLC_UCPHA = _BV(UCPHA0);
+constexpr uint8_t CTRLC_UCPOL = _BV(UCPOL0);
+
+
+/**
+ * UCSRnC value for an SPI mode
+ */
+uint8_t
+mode_bits(spi::Mode mode) {
+    uint8_t ctrlc = CTRLC_MSPIM;
+    if (mode & spi::MODE_1) ctrlc |= CTRLC_UCPHA;
+    if (mode & spi::MODE_2) ctrlc |= CTRLC_UCPOL;
+    return ctrlc;
+}
+
+
+/**
+ * Baud register value for the fastest clock at or below max_freq
+ *
+ * The clock is F_CPU / (2 * (UBRR + 1)).
+ */
+uint16_t
+ubrr_for(uint32_t max_freq) {
+    if (max_freq == 0) return 4095;
+    uint32_t half = (F_CPU / 2 + max_freq - 1) / max_freq;
+    if (half == 0) half = 1;
+    if (half > 4096) half = 4096;
+    return half - 1;
+}
+
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+mspim::Device::Device(gpio::Pin ss, uint32_t max_freq, spi::Mode mode) :
+    ss(ss), ubrr(ubrr_for(max_freq)), ctrlc(mode_bits(mode)) {
+
+    gpio::high(ss);
+    gpio::out(ss);
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+void
+mspim::Device::set_clock(uint32_t max_freq) {
+    ubrr = ubrr_for(max_freq);
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The datasheet order: baud zero, XCK an output, mode, enable, then the
+ * real baud rate.
+ */
+template<uint8_t N>
+void
+mspim::Bus<N>::init(uint32_t freq, spi::Mode mode) {
+    typedef sci::UsartRegs<N> Regs;
+
+    uint16_t ubrr = ubrr_for(freq);
+
+    Regs::baud_high() = 0;
+    Regs::baud_low() = 0;
+    gpio::out<Xck<N>::pin>();
+    Regs::ctrlc() = mode_bits(mode);
+    Regs::ctrlb() = _BV(__CTRLB_RXEN) | _BV(__CTRLB_TXEN);
+    Regs::baud_high() = ubrr >> 8;
+    Regs::baud_low() = ubrr;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * As with spi::configure(), registers are only written when they change.
+ */
+template<uint8_t N>
+void
+mspim::Bus<N>::begin(const Device &device) {
+    typedef sci::UsartRegs<N> Regs;
+
+    if (Regs::ctrlc() != device.ctrlc) {
+        Regs::ctrlc() = device.ctrlc;
+    }
+    if (Regs::baud_low() != (uint8_t) device.ubrr ||
+        Regs::baud_high() != (uint8_t) (device.ubrr >> 8)) {
+        Regs::baud_high() = device.ubrr >> 8;
+        Regs::baud_low() = device.ubrr;
+    }
+    gpio::low(device.ss);
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+void
+mspim::Bus<N>::end(const Device &device) {
+    gpio::high(device.ss);
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+uint8_t
+mspim::Bus<N>::trx_byte(uint8_t input) {
+    typedef sci::UsartRegs<N> Regs;
+
+    while (!(Regs::ctrla() & _BV(__CTRLA_UDRE)));
+    Regs::data() = input;
+    while (!(Regs::ctrla() & _BV(__CTRLA_RXC)));
+    return Regs::data();
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The transmit buffer is kept full, so bytes go out back to back. Received
+ * bytes overrun the receiver and are thrown away once the last byte (TXC)
+ * is out.
+ */
+template<uint8_t N>
+void
+mspim::Bus<N>::write_block(const uint8_t *input, size_t length) {
+    typedef sci::UsartRegs<N> Regs;
+
+    // Clear TXC (write one); the other CTRLA bits do nothing in MSPIM mode
+    Regs::ctrla() = _BV(__CTRLA_TXC);
+
+    while (length--) {
+        uint8_t next = *input++;
+        while (!(Regs::ctrla() & _BV(__CTRLA_UDRE)));
+        Regs::data() = next;
+    }
+
+    while (!(Regs::ctrla() & _BV(__CTRLA_TXC)));
+    while (Regs::ctrla() & _BV(__CTRLA_RXC)) {
+        uint8_t discard = Regs::data();
+        (void) discard;
+    }
+}
+
+
+/**
+ * Shared full-duplex loop
+ *
+ * Two bytes are kept in flight: one shifting and one in the transmit
+ * buffer. Each received byte frees a slot for the next, so the line stays
+ * busy and the two-byte receive FIFO can't overrun.
+ */
+template<uint8_t N>
+static void
+transfer(const uint8_t *input, uint8_t *output, size_t length, uint8_t filler) {
+    typedef sci::UsartRegs<N> Regs;
+
+    size_t sent = 0;
+    while (sent < length && sent < 2) {
+        while (!(Regs::ctrla() & _BV(__CTRLA_UDRE)));
+        Regs::data() = input ? input[sent] : filler;
+        sent++;
+    }
+
+    for (size_t received = 0; received < length; ++received) {
+        uint8_t next = (input && sent < length) ? input[sent] : filler;
+        while (!(Regs::ctrla() & _BV(__CTRLA_RXC)));
+        uint8_t in = Regs::data();
+        if (sent < length) {
+            Regs::data() = next;
+            sent++;
+        }
+        output[received] = in;
+    }
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+void
+mspim::Bus<N>::read_block(uint8_t *output, size_t length, uint8_t filler) {
+    transfer<N>(nullptr, output, length, filler);
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The next input byte is read before its slot frees up, so output may be
+ * the same buffer as input.
+ */
+template<uint8_t N>
+void
+mspim::Bus<N>::trx_block(const uint8_t *input, uint8_t *output, size_t length) {
+    transfer<N>(input, output, length, 0xFF);
+}
+
+
+template class savr::mspim::Bus<0>;
+
+#if defined(SAVR_SCI_USART1)
+template class savr::mspim::Bus<1>;
+#endif
+
+#endif
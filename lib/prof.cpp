@@ -0,0 +1,204 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file prof.cpp
+ *
+ * Profiling probe table and report
+ */
+
+#include <stdio.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/prof.h>
+
+using namespace savr;
+
+#ifdef SAVR_PROFILE_ENABLE
+
+namespace {
+
+//! Probes that have run at least once
+prof::Probe *_probes = nullptr;
+
+//! Cycles an empty probe measures, taken off every run
+uint16_t _overhead = 0;
+
+
+/**
+ * Histogram bucket for a duration: its bit length, capped
+ */
+uint8_t
+bucket(uint16_t cycles) {
+    uint8_t bits = 0;
+    while (cycles) {
+        bits++;
+        cycles >>= 1;
+    }
+    return bits < prof::BUCKETS ? bits : prof::BUCKETS - 1;
+}
+
+
+/**
+ * Clear one probe's counters
+ */
+void
+clear(prof::Probe &probe) {
+    probe.count = 0;
+    probe.total = 0;
+    probe.min = UINT16_MAX;
+    probe.max = 0;
+    for (uint8_t i = 0; i < prof::BUCKETS; ++i) {
+        probe.hist[i] = 0;
+    }
+}
+
+}
+
+
+/**
+ * @par Implementation Notes:
+ * Timer1 runs in normal mode with no prescaler. The overhead is the
+ * shortest of a few empty probes, which is the cost of now() plus the
+ * call into record().
+ */
+void
+prof::init() {
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    TCCR1B = _BV(CS10);
+
+    static Probe calibrate(nullptr);
+    clear(calibrate);
+    _overhead = 0;
+    for (uint8_t i = 0; i < 8; ++i) {
+        Scope scope(calibrate);
+    }
+    _overhead = calibrate.min;
+
+    // Keep the calibration probe out of the report. It went in at the head
+    // of the table on its first run; later init() calls find it gone.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_probes == &calibrate) {
+            _probes = calibrate.next;
+        }
+    }
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The end time is read first, so the bookkeeping below is not counted.
+ * Locked, since the same probe may run in an ISR and in the main loop.
+ */
+void
+prof::record(Probe &probe, uint16_t start) {
+    uint16_t cycles = now() - start;
+    cycles = cycles > _overhead ? cycles - _overhead : 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (!probe.linked) {
+            probe.next = _probes;
+            _probes = &probe;
+            probe.linked = true;
+        }
+
+        probe.count++;
+        probe.total += cycles;
+        if (cycles < probe.min) probe.min = cycles;
+        if (cycles > probe.max) probe.max = cycles;
+
+        uint16_t &slot = probe.hist[bucket(cycles)];
+        if (slot != UINT16_MAX) slot++;
+    }
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+void
+prof::reset() {
+    for (Probe *probe = _probes; probe; probe = probe->next) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            clear(*probe);
+        }
+    }
+}
+
+
+/**
+ * @par Implementation Notes:
+ * Each probe is copied before printing, so a probe that runs while we
+ * print (say, in the SCI path) does not tear its own line. The histogram
+ * lists only non-empty buckets, by their upper bound.
+ */
+uint8_t
+prof::command(char *) {
+    printf_P(PSTR("%-20S %8s %6s %6s %6s\n"),
+             PSTR("probe"), "count", "min", "avg", "max");
+
+    for (Probe *probe = _probes; probe; probe = probe->next) {
+        Probe snap(probe->name);
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            snap = *probe;
+            clear(*probe);
+        }
+
+        if (snap.count == 0) {
+            printf_P(PSTR("%-20S %8lu\n"), snap.name, 0UL);
+            continue;
+        }
+
+        printf_P(PSTR("%-20S %8lu %6u %6lu %6u\n"), snap.name,
+                 static_cast<unsigned long>(snap.count), snap.min,
+                 static_cast<unsigned long>(snap.total / snap.count), snap.max);
+
+        for (uint8_t i = 0; i < BUCKETS; ++i) {
+            if (snap.hist[i] == 0) continue;
+            if (i == BUCKETS - 1) {
+                printf_P(PSTR("    >=%-6lu %u\n"), 1UL << (i - 1), snap.hist[i]);
+            } else {
+                printf_P(PSTR("     <%-6lu %u\n"), 1UL << i, snap.hist[i]);
+            }
+        }
+    }
+    return 0;
+}
+
+#else
+
+void
+prof::init() {}
+
+
+void
+prof::reset() {}
+
+
+uint8_t
+prof::command(char *) {
+    puts_P(PSTR("Profiling is off (build with -DSAVR_PROFILE_ENABLE)"));
+    return 0;
+}
+
+#endif
@@ -28,11 +28,18 @@
 #include <savr/rfm69.h>
 #include <savr/utils.h>
 #include <savr/optimized.h>
+#include <savr/trace.h>
 
 using namespace savr;
 
 
 namespace {
+/**
+ * The radio's settings on the shared SPI bus
+ */
+spi::Device _device;
+
+
 /**
  * Common code for setting or reading registers
  *
@@ -47,10 +54,10 @@ _common_trx(rfm69::Reg reg, uint8_t tx, bool write) {
         reg = static_cast<rfm69::Reg>(reg | rfm69::REG_WRITE);
     }
 
-    gpio::low<rfm69::PIN_SS>();
+    spi::begin(_device);
     spi::trx_byte(reg);
     uint8_t res = spi::trx_byte(tx);
-    gpio::high<rfm69::PIN_SS>();
+    spi::end(_device);
 
     return res;
 }
@@ -91,8 +98,7 @@ uint8_t _last_gain;
 
 void
 rfm69::init(uint32_t bitrate, uint32_t center_freq, uint32_t freq_dev) {
-    gpio::high<PIN_SS>();
-    gpio::out<PIN_SS>();
+    _device = spi::Device(PIN_SS, SPI_MAX_CLOCK);
 
     gpio::in<PIN_DIO0>();
     gpio::low<PIN_DIO0>();
@@ -125,6 +131,7 @@ rfm69::rx_pdu(void *dst, size_t length) {
     packet_length = read_reg(REG_FIFO);
     read_reg(REG_FIFO,
              dst, length < packet_length ? length : packet_length);
+    SAVR_TRACE(trace::EV_RFM_RX, packet_length);
 
     return packet_length;
 }
@@ -138,6 +145,7 @@ rfm69::tx_pdu(void *src, size_t length) {
     if (length > MTU) {
         length = MTU;
     }
+    SAVR_TRACE(trace::EV_RFM_TX, length);
 
     // Payload is length + data
     write_reg(REG_FIFO, length);
@@ -151,6 +159,95 @@ rfm69::tx_pdu(void *src, size_t length) {
     set_mode(MODE_SLEEP, false);
 }
 
+/**
+ * @par Implementation Notes:
+ * Mode changes are short (tens of microseconds), but are waited on like
+ * everything else so the protothread never spins. A timeout still runs to
+ * PT_END, with nothing received.
+ */
+pt::State
+rfm69::rx_pdu_pt(pt::Pt *self, void *dst, size_t length, uint16_t timeout,
+                 size_t &received) {
+    PT_BEGIN(self);
+
+    received = 0;
+    write_reg(REG_DIO_MAP_1, DIO0_PKT_RX_PAYLOAD_READY);
+
+    set_mode(MODE_RX, false);
+    PT_WAIT_UNTIL(self, check_reg(REG_IRQ_FLAGS_1, IRQ_1_MODE_READY));
+
+    // Wait for a packet
+    if (timeout) {
+        PT_WAIT_UNTIL_TIMEOUT(self, gpio::get<PIN_DIO0>(), timeout);
+    } else {
+        PT_WAIT_UNTIL(self, gpio::get<PIN_DIO0>());
+    }
+
+    if (timeout && PT_TIMED_OUT(self)) {
+        SAVR_TRACE(trace::EV_RFM_TIMEOUT, timeout);
+        set_mode(MODE_SLEEP, false);
+    } else {
+        _last_rssi = sample_rssi(true);
+        _last_gain = LNA_CURRENT_GAIN::get(read_reg(REG_LNA));
+
+        // Go back to sleep once done receiving
+        set_mode(MODE_SLEEP, false);
+
+        // Read out the packet from the FIFO
+        received = read_reg(REG_FIFO);
+        read_reg(REG_FIFO, dst, length < received ? length : received);
+        SAVR_TRACE(trace::EV_RFM_RX, received);
+    }
+
+    PT_END(self);
+}
+
+
+/**
+ * @par Implementation Notes:
+ * As in rx_pdu_pt(), a timeout of 0 waits without a limit.
+ */
+pt::State
+rfm69::tx_pdu_pt(pt::Pt *self, void *src, size_t length, uint16_t timeout,
+                 bool &sent) {
+    PT_BEGIN(self);
+
+    sent = false;
+
+    // Fill up the FIFO in sleep/stdby mode
+    set_mode(MODE_STDBY, false);
+    PT_WAIT_UNTIL(self, check_reg(REG_IRQ_FLAGS_1, IRQ_1_MODE_READY));
+    write_reg(REG_DIO_MAP_1, DIO0_PKT_TX_PACKET_SENT);
+
+    if (length > MTU) {
+        length = MTU;
+    }
+    SAVR_TRACE(trace::EV_RFM_TX, length);
+
+    // Payload is length + data
+    write_reg(REG_FIFO, length);
+    write_reg(REG_FIFO, src, length);
+
+    // Trigger the transmit
+    set_mode(MODE_TX, false);
+
+    if (timeout) {
+        PT_WAIT_UNTIL_TIMEOUT(self, gpio::get<PIN_DIO0>(), timeout);
+        sent = !PT_TIMED_OUT(self);
+        if (!sent) {
+            SAVR_TRACE(trace::EV_RFM_TIMEOUT, timeout);
+        }
+    } else {
+        PT_WAIT_UNTIL(self, gpio::get<PIN_DIO0>());
+        sent = true;
+    }
+
+    // Go back to sleep once done sending
+    set_mode(MODE_SLEEP, false);
+
+    PT_END(self);
+}
+
 //bool
 //rfm69::tx_pdu_arq(void *src, size_t length, size_t timeout,
 //                  uint8_t retry) {
@@ -261,6 +358,7 @@ rfm69::set_mode(uint8_t mode, bool wait) {
     uint8_t reg = read_reg(REG_OP_MODE);
     reg = MODE::raw_update(reg, mode);
     write_reg(REG_OP_MODE, reg);
+    SAVR_TRACE(trace::EV_RFM_MODE, mode);
 
     // Don't return until the mode is ready
     if (wait) {
@@ -288,10 +386,10 @@ rfm69::read_reg(rfm69::Reg reg) {
 
 void
 rfm69::read_reg(rfm69::Reg reg, void *dst, size_t length) {
-    gpio::low<PIN_SS>();
+    spi::begin(_device);
     spi::trx_byte(reg);
     spi::read_block(reinterpret_cast<uint8_t *>(dst), length, 0);
-    gpio::high<PIN_SS>();
+    spi::end(_device);
 }
 
 void
@@ -303,10 +401,10 @@ void
 rfm69::write_reg(rfm69::Reg reg, void *src, size_t length) {
     reg = static_cast<Reg>(reg | REG_WRITE);
 
-    gpio::low<PIN_SS>();
+    spi::begin(_device);
     spi::trx_byte(reg);
     spi::write_block(reinterpret_cast<uint8_t *>(src), length);
-    gpio::high<PIN_SS>();
+    spi::end(_device);
 }
 
 uint8_t
@@ -0,0 +1,55 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+
+/**
+ * @file sci1.cpp
+ *
+ * USART1, where present
+ */
+
+#include <savr/sci.h>
+
+#include "sci_usart.h"
+
+#if !defined(SAVR_NO_SCI) && defined(SAVR_SCI_USART1)
+
+using namespace savr;
+
+template class savr::sci::Usart<1>;
+
+
+/**
+ * Handle received data
+ */
+ISR(__RX1_VECT) {
+    sci::Usart<1>::rx_isr();
+}
+
+
+/**
+ * Handle transmitting data
+ */
+ISR(__TX1_VECT) {
+    sci::Usart<1>::tx_isr();
+}
+
+#endif
@@ -0,0 +1,67 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file sci_stats.cpp
+ *
+ * Terminal command for the SCI counters
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/sci.h>
+
+#ifndef SAVR_NO_SCI
+
+using namespace savr;
+
+
+/**
+ * Print the USART0 counters
+ *
+ * @par Implementation Notes:
+ * The counters are copied before printing, since printing itself adds to
+ * tx_bytes and the transmit high-water mark.
+ */
+uint8_t
+sci::stats_command(char *args) {
+    Stats stats;
+    get_stats(stats);
+
+    if (strcmp_P(args, PSTR("reset")) == 0) {
+        reset_stats();
+    }
+
+    printf_P(PSTR("rx bytes:   %lu\n"), static_cast<unsigned long>(stats.rx_bytes));
+    printf_P(PSTR("tx bytes:   %lu\n"), static_cast<unsigned long>(stats.tx_bytes));
+    printf_P(PSTR("overrun:    %u\n"), stats.rx_overrun);
+    printf_P(PSTR("framing:    %u\n"), stats.rx_framing);
+    printf_P(PSTR("parity:     %u\n"), stats.rx_parity);
+    printf_P(PSTR("rx dropped: %u\n"), stats.rx_dropped);
+    printf_P(PSTR("tx dropped: %u\n"), stats.tx_dropped);
+    printf_P(PSTR("rx hwm:     %u\n"), stats.rx_high_water);
+    printf_P(PSTR("tx hwm:     %u\n"), stats.tx_high_water);
+    return 0;
+}
+
+#endif
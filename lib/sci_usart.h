@@ -0,0 +1,618 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_sci_usart_h_included_
+#define _savr_sci_usart_h_included_
+
+/**
+ * @file sci_usart.h
+ *
+ * Usart<N> implementation, private to the library.
+ *
+ * Each port has its own translation unit (sci.cpp, sci1.cpp, ...) that
+ * explicitly instantiates Usart<N> and defines the port's interrupt vectors.
+ * A port's buffers and ISRs are then only linked in when the port is used.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <util/atomic.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/sci.h>
+#include <savr/queue.h>
+#include <savr/trace.h>
+#include <savr/utils.h>
+
+#include <savr/sci_defs.h>
+
+#include "sleep_regs.h"
+
+#if !defined(SAVR_NO_SCI)
+
+#ifndef SCI_TX_BUFFER_SIZE
+#define SCI_TX_BUFFER_SIZE 8
+#endif
+
+#ifndef SCI_RX_BUFFER_SIZE
+#define SCI_RX_BUFFER_SIZE 8
+#endif
+
+#ifndef SCI1_TX_BUFFER_SIZE
+#define SCI1_TX_BUFFER_SIZE 8
+#endif
+
+#ifndef SCI1_RX_BUFFER_SIZE
+#define SCI1_RX_BUFFER_SIZE 8
+#endif
+
+namespace savr {
+namespace sci {
+namespace {
+
+/**
+ * Build-time buffer depths for each port
+ */
+template<uint8_t N>
+struct UsartConfig;
+
+template<>
+struct UsartConfig<0> {
+    static constexpr uint8_t TX_SIZE = SCI_TX_BUFFER_SIZE;
+    static constexpr uint8_t RX_SIZE = SCI_RX_BUFFER_SIZE;
+};
+
+template<>
+struct UsartConfig<1> {
+    static constexpr uint8_t TX_SIZE = SCI1_TX_BUFFER_SIZE;
+    static constexpr uint8_t RX_SIZE = SCI1_RX_BUFFER_SIZE;
+};
+
+
+//! Caller-owned buffer being sent by send_async()
+struct AsyncTx {
+    const uint8_t *data;
+    size_t remaining;
+    bool progmem;
+    TxCallback callback;
+};
+
+
+/**
+ * All state for one port
+ *
+ * Each buffer has one producer and one consumer (the main loop and an ISR), so
+ * the lock-free queue is used and the UART interrupts are never masked.
+ */
+template<uint8_t N>
+struct UsartState {
+    //! Circular transmit buffer
+    SpscQueue<uint8_t, UsartConfig<N>::TX_SIZE> tx_buffer;
+
+    //! Circular receive buffer
+    SpscQueue<uint8_t, UsartConfig<N>::RX_SIZE> rx_buffer;
+
+    FILE out;
+    FILE in;
+
+    AsyncTx async_tx;
+
+    //! Optional consumer of received bytes, in place of rx_buffer
+    RxHook rx_hook;
+
+    //! Set by the main line to hand async_tx to the ISR, cleared by the ISR
+    volatile bool async_active;
+
+    //! stdout overflow policy, see set_overflow()
+    Overflow overflow;
+    uint16_t overflow_timeout;
+    TickSource overflow_now;
+
+    //! A timed wait expired, and the buffer has not had room since
+    bool overflow_expired;
+
+#ifndef SCI_NO_STATS
+    //! Counters, written by both ISRs; tx_high_water by the main line
+    Stats stats;
+#endif
+};
+
+template<uint8_t N>
+UsartState<N> state;
+
+
+/**
+ * Record the transmit buffer level after queueing data
+ */
+template<uint8_t N>
+FORCE_INLINE void
+note_tx_level() {
+#ifndef SCI_NO_STATS
+    uint8_t level = state<N>.tx_buffer.size();
+    if (level > state<N>.stats.tx_high_water) {
+        state<N>.stats.tx_high_water = level;
+    }
+#endif
+}
+
+
+/**
+ * Start the transmitter draining the buffer
+ */
+template<uint8_t N>
+FORCE_INLINE void
+tx_kick() {
+    UsartRegs<N>::ctrlb() |= _BV(__CTRLB_UDRIE);
+}
+
+
+/**
+ * Count a byte discarded by the overflow policy
+ */
+template<uint8_t N>
+FORCE_INLINE void
+note_tx_drop() {
+#ifndef SCI_NO_STATS
+    state<N>.stats.tx_dropped++;
+#endif
+    SAVR_TRACE(trace::EV_SCI_TX_DROP, N);
+}
+
+
+/**
+ * Wait for the transmitter to make room in the buffer
+ *
+ * If interrupts are disabled the transmit ISR can never run, so the UART is
+ * polled and the ISR body is run directly instead.
+ */
+template<uint8_t N>
+FORCE_INLINE void
+tx_wait() {
+    if ((SREG & _BV(SREG_I)) == 0 &&
+            (UsartRegs<N>::ctrla() & _BV(__CTRLA_UDRE))) {
+        Usart<N>::tx_isr();
+    }
+}
+
+
+/**
+ * Place a byte in the transmit buffer, applying the overflow policy when full
+ */
+template<uint8_t N>
+void
+put_byte(uint8_t input) {
+    UsartState<N> &st = state<N>;
+
+    if (st.tx_buffer.enq(input)) {
+        switch (st.overflow) {
+        case OVERFLOW_DROP_NEWEST:
+            note_tx_drop<N>();
+            return;
+
+        case OVERFLOW_DROP_OLDEST:
+            // The ISR is the only consumer, so hold it off while stealing
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                if (st.tx_buffer.enq(input)) {
+                    uint8_t discard;
+                    st.tx_buffer.deq(&discard);
+                    st.tx_buffer.enq(input);
+                    note_tx_drop<N>();
+                }
+            }
+            break;
+
+        case OVERFLOW_TIMEOUT:
+            if (st.overflow_now) {
+                if (st.overflow_expired) {
+                    note_tx_drop<N>();
+                    return;
+                }
+                uint32_t start = st.overflow_now();
+                while (st.tx_buffer.enq(input)) {
+                    if (st.overflow_now() - start >= st.overflow_timeout) {
+                        st.overflow_expired = true;
+                        note_tx_drop<N>();
+                        return;
+                    }
+                    tx_wait<N>();
+                }
+                break;
+            }
+            // No time source, so just block
+            // fall through
+
+        default:
+            while (st.tx_buffer.enq(input)) {
+                tx_wait<N>();
+            }
+            break;
+        }
+    }
+
+    st.overflow_expired = false;
+    note_tx_level<N>();
+    tx_kick<N>();
+}
+
+
+/**
+ * Put a character into the UART queue
+ *
+ * Blocking Function - Place a single character on the TxBuffer
+ */
+template<uint8_t N>
+int
+write_char(char input, FILE *) {
+    if (input == '\n')
+        put_byte<N>('\r');
+
+    put_byte<N>(static_cast<uint8_t>(input));
+    return 0;
+}
+
+
+/**
+ * Get a character from the UART queue
+ *
+ * Blocking Function - Get next char on the RxBuffer
+ *
+ * The CPU sleeps (idle mode) while the buffer is empty. Only an interrupt
+ * can fill it, so this only happens with interrupts enabled. They are
+ * disabled across the final check so a byte can't arrive between the check
+ * and the sleep; sleep_cpu() right after sei() runs before any interrupt.
+ * The application's sleep mode is put back after waking.
+ */
+template<uint8_t N>
+int
+read_char(FILE *) {
+    uint8_t ret_val;
+    while (state<N>.rx_buffer.deq(&ret_val)) {
+        if (SREG & _BV(SREG_I)) {
+            cli();
+            if (state<N>.rx_buffer.size() == 0) {
+                uint8_t mode = get_sleep_mode();
+                set_sleep_mode(SLEEP_MODE_IDLE);
+                sleep_enable();
+                sei();
+                sleep_cpu();
+                cli();
+                sleep_disable();
+                restore_sleep_mode(mode);
+            }
+            sei();
+        }
+    }
+    return ret_val;
+}
+
+}
+
+
+/**
+ * @par Implementation Notes:
+ *
+ * The streams are always set up, so they can be bound at any time. Each
+ * stream's udata holds the port's size() so sci::size() works on any port.
+ */
+template<uint8_t N>
+void
+Usart<N>::init(uint32_t baud) {
+    typedef UsartRegs<N> Regs;
+
+    // Set Baud Rate.
+    uint16_t brate = ubrr_setting(baud);
+    Regs::baud_high() = static_cast<uint8_t>(brate >> 8);
+    Regs::baud_low() = static_cast<uint8_t>(brate);
+
+    /* Frame Format - 8 data, no parity */
+    /* NEED URSEL FOR MEGA16/32 */
+    Regs::ctrla() = _BV(__CTRLA_U2X);
+    Regs::ctrlc() = __CTRLC_ENABLE | _BV(__CTRLC_UCSZ1) |
+                    _BV(__CTRLC_UCSZ0);// | _BV(UPM1) | _BV(UPM0);
+
+    /* Enable Rx and Tx, and interrupt */
+    Regs::ctrlb() = _BV(__CTRLB_RXCIE) | _BV(__CTRLB_RXEN) |
+                    _BV(__CTRLB_TXEN);
+
+    fdev_setup_stream(&state<N>.out, write_char<N>, nullptr,
+                      _FDEV_SETUP_WRITE);
+    fdev_setup_stream(&state<N>.in, nullptr, read_char<N>,
+                      _FDEV_SETUP_READ);
+
+    size_t (*size_fn)(FILE *) = size;
+    fdev_set_udata(&state<N>.out, reinterpret_cast<void *>(size_fn));
+    fdev_set_udata(&state<N>.in, reinterpret_cast<void *>(size_fn));
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+void
+Usart<N>::bind_stdio() {
+    stdout = &state<N>.out;
+    stdin = &state<N>.in;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+FILE *
+Usart<N>::out() {
+    return &state<N>.out;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+FILE *
+Usart<N>::in() {
+    return &state<N>.in;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+size_t
+Usart<N>::size(FILE *stream) {
+    if (stream == &state<N>.out) {
+        return state<N>.tx_buffer.size();
+    }
+    return state<N>.rx_buffer.size();
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+size_t
+Usart<N>::write(const void *src, size_t length) {
+    size_t count = state<N>.tx_buffer.enq_n(
+        static_cast<const uint8_t *>(src), length);
+    if (count) {
+        note_tx_level<N>();
+        tx_kick<N>();
+    }
+    return count;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+size_t
+Usart<N>::read(void *dst, size_t length) {
+    return state<N>.rx_buffer.deq_n(static_cast<uint8_t *>(dst), length);
+}
+
+
+/**
+ * @par Implementation Notes:
+ *
+ * The pointer is two bytes, so it is swapped with the receive ISR held off.
+ */
+template<uint8_t N>
+void
+Usart<N>::set_rx_hook(RxHook hook) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        state<N>.rx_hook = hook;
+    }
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+void
+Usart<N>::set_overflow(Overflow policy, uint16_t timeout, TickSource now) {
+    UsartState<N> &st = state<N>;
+    st.overflow = policy;
+    st.overflow_timeout = timeout;
+    st.overflow_now = now;
+    st.overflow_expired = false;
+}
+
+
+/**
+ * @par Implementation Notes:
+ *
+ * The ISRs update the counters, so the copy is taken with them held off.
+ */
+template<uint8_t N>
+void
+Usart<N>::get_stats(Stats &stats) {
+#ifndef SCI_NO_STATS
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        stats = state<N>.stats;
+    }
+#else
+    stats = Stats();
+#endif
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+void
+Usart<N>::reset_stats() {
+#ifndef SCI_NO_STATS
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        state<N>.stats = Stats();
+    }
+#endif
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+bool
+Usart<N>::send_async(const uint8_t *buf, size_t length, TxCallback callback,
+                     bool progmem) {
+    UsartState<N> &st = state<N>;
+
+    if (st.async_active) {
+        return false;
+    }
+
+    if (length == 0) {
+        if (callback) callback();
+        return true;
+    }
+
+    st.async_tx.data = buf;
+    st.async_tx.remaining = length;
+    st.async_tx.progmem = progmem;
+    st.async_tx.callback = callback;
+    COMPILER_BARRIER();
+    st.async_active = true;
+    tx_kick<N>();
+    return true;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+template<uint8_t N>
+bool
+Usart<N>::async_busy() {
+    return state<N>.async_active;
+}
+
+
+/**
+ * @par Implementation Notes:
+ *
+ * The error flags belong to the byte at the head of the receive FIFO, so the
+ * status register must be read before the data register.
+ */
+template<uint8_t N>
+FORCE_INLINE void
+Usart<N>::rx_isr() {
+    UsartState<N> &st = state<N>;
+
+#if !defined(SCI_NO_STATS) || defined(SAVR_TRACE_ENABLE)
+    uint8_t status = UsartRegs<N>::ctrla();
+#endif
+    uint8_t rx_data = UsartRegs<N>::data();
+
+#ifdef SAVR_TRACE_ENABLE
+    uint8_t errors = status & (_BV(__CTRLA_DOR) | _BV(__CTRLA_FE) | _BV(__CTRLA_UPE));
+    if (errors) {
+        SAVR_TRACE(trace::EV_SCI_RX_ERROR, (N << 8) | errors);
+    }
+#endif
+
+#ifndef SCI_NO_STATS
+    st.stats.rx_bytes++;
+    if (status & (_BV(__CTRLA_DOR) | _BV(__CTRLA_FE) | _BV(__CTRLA_UPE))) {
+        if (status & _BV(__CTRLA_DOR)) st.stats.rx_overrun++;
+        if (status & _BV(__CTRLA_FE))  st.stats.rx_framing++;
+        if (status & _BV(__CTRLA_UPE)) st.stats.rx_parity++;
+    }
+#endif
+
+    RxHook hook = st.rx_hook;
+    if (hook) {
+        hook(rx_data);
+        return;
+    }
+
+    if (st.rx_buffer.enq(rx_data)) {
+        SAVR_TRACE(trace::EV_SCI_RX_DROP, (N << 8) | rx_data);
+#ifndef SCI_NO_STATS
+        st.stats.rx_dropped++;
+#endif
+        return;
+    }
+
+#ifndef SCI_NO_STATS
+    uint8_t level = st.rx_buffer.size();
+    if (level > st.stats.rx_high_water) {
+        st.stats.rx_high_water = level;
+    }
+#endif
+}
+
+
+/**
+ * @par Implementation Notes:
+ *
+ * The buffer is drained first, then any caller-owned async data.
+ */
+template<uint8_t N>
+FORCE_INLINE void
+Usart<N>::tx_isr() {
+    UsartState<N> &st = state<N>;
+    uint8_t tx_data;
+
+    if (st.tx_buffer.deq(&tx_data) == 0) {
+        UsartRegs<N>::data() = tx_data;
+#ifndef SCI_NO_STATS
+        st.stats.tx_bytes++;
+#endif
+        return;
+    }
+
+    if (!st.async_active) {
+        UsartRegs<N>::ctrlb() &= ~_BV(__CTRLB_UDRIE);
+        return;
+    }
+
+    const uint8_t *data = st.async_tx.data;
+    UsartRegs<N>::data() = st.async_tx.progmem ? pgm_read_byte(data) : *data;
+    st.async_tx.data = data + 1;
+#ifndef SCI_NO_STATS
+    st.stats.tx_bytes++;
+#endif
+
+    if (--st.async_tx.remaining == 0) {
+        // Release before the callback, so it can start another send
+        st.async_active = false;
+        if (st.async_tx.callback) {
+            st.async_tx.callback();
+        }
+    }
+}
+
+}
+}
+
+#endif
+
+#endif /* _savr_sci_usart_h_included_ */
@@ -26,12 +26,14 @@
 #include <avr/interrupt.h>
 
 #include <stdio.h>
+#include <util/crc16.h>
 
 #include <savr/cpp_pgmspace.h>
 #include <savr/sd.h>
 #include <savr/spi.h>
 #include <savr/utils.h>
 #include <savr/crc.h>
+#include <savr/trace.h>
 
 using namespace savr;
 
@@ -51,7 +53,9 @@ using namespace savr;
 #define CMD_SEND_STATUS             13    // Request card send status
 #define CMD_SET_BLOCKLEN            16    // Set block length (in bytes)
 #define CMD_READ_BLOCK              17    // Read a block of data
+#define CMD_READ_MULTIPLE_BLOCK     18    // Read blocks until CMD12
 #define CMD_WRITE_BLOCK             24    // Write a block of data
+#define CMD_WRITE_MULTIPLE_BLOCK    25    // Write blocks until a stop token
 #define CMD_ERASE_BLOCK_START       32    // Set first sector for erase
 #define CMD_ERASE_BLOCK_END         33    // Set last sector for erase
 #define CMD_ERASE                   38    // Erase all selected sectors
@@ -60,6 +64,7 @@ using namespace savr;
 
 #define APP_CMD                     55    // Signal start of application specific command
 #define SD_SEND_OP_COND             41    // Send operation conditions on host side
+#define SD_SET_WR_BLK_ERASE_COUNT   23    // Pre-erase blocks before a multi-block write
 
 #define R1_IDLE                     0x01
 #define R1_ERASE_RESET              0x02
@@ -74,6 +79,16 @@ using namespace savr;
 #define BLOCK_SIZE                  512
 #define FILL_BYTE                   0xFF
 #define START_BLOCK                 0xFE
+#define START_BLOCK_MULTI           0xFC  // Data token in a multi-block write
+#define STOP_TRAN                   0xFD  // Ends a multi-block write
+
+#define DATA_TOKEN_POLLS            50000 // Read access time, up to 100ms
+#define READY_POLLS                 100000uL  // Write busy time, up to 250ms
+
+#define IF_COND_CHECK               0x1AA // 2.7-3.6V, check pattern 0xAA
+#define OCR_HCS                     0x40000000uL  // Host supports high capacity
+#define OCR_CCS                     0x40  // Card capacity status (OCR byte 0)
+#define INIT_POLLS                  10000
 
 static void
 delay_bytes(uint16_t bytes);
@@ -81,6 +96,24 @@ delay_bytes(uint16_t bytes);
 static void
 send_command(uint8_t command, uint32_t arg);
 
+static void
+send_frame(uint8_t command, uint32_t arg);
+
+static uint32_t
+to_card(uint32_t addr);
+
+static uint32_t
+to_card_block(uint32_t block);
+
+static uint8_t
+wait_op_cond(uint8_t command, uint32_t arg);
+
+static uint8_t
+poll_response();
+
+static bool
+wait_ready();
+
 static uint8_t
 check_for_card();
 
@@ -88,7 +121,7 @@ static uint8_t
 get_response(uint8_t *buf, uint16_t length);
 
 static uint8_t
-read_data(uint8_t *buf, uint16_t length);
+read_data(uint8_t *buf, uint16_t length, uint16_t skip = 0, uint16_t trail = 0);
 
 static void
 decode_r1(uint8_t res);
@@ -104,11 +137,14 @@ decode_data_err(uint8_t res);
 static uint8_t
 crc7(const uint8_t *bytes, size_t length);
 
-static uint16_t
-crc16(const uint8_t *bytes, size_t length);
+static void
+send_data(const uint8_t *data, size_t size);
+
+static bool
+receive_data(uint8_t *buf, uint16_t length, uint16_t skip, uint16_t trail);
 
 static uint16_t
-crc16_fill(uint16_t crc, uint8_t const_value, size_t length);
+clock_bytes(uint8_t value, uint16_t count, uint16_t crc);
 
 
 // Error printing used all over the place
@@ -118,7 +154,15 @@ error(uint8_t cmd, uint8_t res);
 
 // sd::* is already non-reentrant, so a global buffer is... OK...
 static uint8_t scratch[32];
-static gpio::Pin _ss;
+static spi::Device _dev;
+static bool _high_capacity;
+
+//! Multi-block transfer in progress, if any
+static enum {
+    STREAM_NONE,
+    STREAM_READ,
+    STREAM_WRITE,
+} _stream;
 
 
 /**
@@ -126,14 +170,13 @@ static gpio::Pin _ss;
  */
 uint8_t
 sd::init(gpio::Pin ss) {
-    uint16_t i;
     uint8_t res;
+    bool v2;
 
-    _ss = ss;
+    _dev = spi::Device(ss, INIT_CLOCK);
 
-    // Delay a buncha clocks
-    gpio::out(_ss);
-    gpio::high(_ss);
+    // Delay a buncha clocks, with the card deselected
+    spi::configure(_dev);
     delay_bytes(20);
 
     // Check if the card is inserted
@@ -143,26 +186,64 @@ sd::init(gpio::Pin ss) {
     }
     printf_P(PSTR("Card found\n"));
 
-    // Standard init commands
-    send_command(CMD_SEND_IF_COND, 0);
-    res = get_response(scratch, 5);
+    _high_capacity = false;
 
-    send_command(CMD_READ_OCR, 0);
+    // Version 2.00 cards answer CMD8 with R7, echoing the check pattern.
+    // Older cards and MMC reject it as illegal; anything else is an error.
+    send_command(CMD_SEND_IF_COND, IF_COND_CHECK);
     res = get_response(scratch, 5);
+    if (res != R1_IDLE && res != (R1_IDLE | R1_ILLEGAL_CMD)) {
+        error(CMD_SEND_IF_COND, res);
+        decode_r1(res);
+        return 0;
+    }
+    v2 = (res == R1_IDLE);
+    if (v2 && ((scratch[3] & 0x0F) != (IF_COND_CHECK >> 8) ||
+               scratch[4] != (IF_COND_CHECK & 0xFF))) {
+        printf_P(PSTR("Error: Unusable card (R7 %02hX%02hX)\n"),
+                 scratch[3], scratch[4]);
+        return 0;
+    }
 
-    // Wait for card to init fully
-    i = 0;
-    do {
-        send_command(CMD_SEND_OP_COND, 0);
-        res = get_response(scratch, 1);
-        i++;
-    } while (res && i < 10000);
+    // Wait for card to init fully. ACMD41 with HCS set on 2.00 cards; MMC
+    // rejects ACMD41 and only knows CMD1.
+    res = wait_op_cond(SD_SEND_OP_COND, v2 ? OCR_HCS : 0);
+    if (res & R1_ILLEGAL_CMD) {
+        res = wait_op_cond(CMD_SEND_OP_COND, 0);
+    }
 
     if (res) {
         error(CMD_SEND_OP_COND, res);
         return 0;
     }
 
+    if (v2) {
+        // CCS is only valid once the card is ready
+        send_command(CMD_READ_OCR, 0);
+        res = get_response(scratch, 5);
+        if (res) {
+            error(CMD_READ_OCR, res);
+            decode_r1(res);
+            return 0;
+        }
+        _high_capacity = scratch[1] & OCR_CCS;
+    }
+
+    // Out of the identification phase; full speed from here on
+    _dev.set_clock(MAX_CLOCK);
+
+    // High capacity cards have a fixed 512-byte block. Set it once for the
+    // rest, instead of before every transfer.
+    if (!_high_capacity) {
+        send_command(CMD_SET_BLOCKLEN, BLOCK_SIZE);
+        res = get_response(scratch, 1);
+        if (res) {
+            error(CMD_SET_BLOCKLEN, res);
+            decode_r1(res);
+            return 0;
+        }
+    }
+
 #ifdef SD_USE_CRC
     send_command(CMD_CRC_ONOFF, 1);
 #else
@@ -170,15 +251,15 @@ sd::init(gpio::Pin ss) {
 #endif
     res = get_response(scratch, 1);
     if (res) {
-        error(CMD_SEND_CID, res);
+        error(CMD_CRC_ONOFF, res);
         decode_r1(res);
         return 0;
     }
 
 
     send_command(CMD_SEND_CID, 0);
-    // 128bits + 16 CRC
-    res = get_response(scratch, 1) || !read_data(scratch, 18);
+    // 128bits, then a CRC checked by read_data()
+    res = get_response(scratch, 1) || !read_data(scratch, 16);
 
     if (res) {
         error(CMD_SEND_CID, res);
@@ -188,43 +269,51 @@ sd::init(gpio::Pin ss) {
     printf_P(PSTR("CID: "));
     utils::print_hex(scratch, 16);
     putchar('\n');
-    //printf(" crc16: %d\n", crc16(scratch, 18));
 
     send_command(CMD_SEND_CSD, 0);
-    // 128bits + 16 CRC
-    res = get_response(scratch, 1) || !read_data(scratch, 18);
+    // 128bits, then a CRC checked by read_data()
+    res = get_response(scratch, 1) || !read_data(scratch, 16);
 
     if (res) {
-        error(CMD_SEND_CID, res);
+        error(CMD_SEND_CSD, res);
         return 0;
     }
 
     printf_P(PSTR("CSD: "));
     utils::print_hex(scratch, 16);
     putchar('\n');
-    //printf(" crc16: %d\n", crc16(scratch, 18));
+
+    printf_P(_high_capacity ? PSTR("SDHC/SDXC\n") : PSTR("SDSC\n"));
 
     return 1;
 }
 
 
+/**
+ * @par Implementation Notes:
+ */
+bool
+sd::high_capacity() {
+    return _high_capacity;
+}
+
+
 /**
  * @par Implementation Notes:
  */
 uint8_t
 sd::read_block(uint32_t addr, uint8_t *buf, size_t size) {
     uint8_t res;
+    uint16_t offset = addr % BLOCK_SIZE;
 
-    // Set the block length... won't work on SDHC
-    send_command(CMD_SET_BLOCKLEN, size);
-    res = get_response(scratch, 1);
-    if (res) {
-        error(CMD_SET_BLOCKLEN, res);
-        decode_r1(res);
+    if (offset + size > BLOCK_SIZE) {
+        error(CMD_READ_BLOCK, 0);
         return 0;
     }
 
-    send_command(CMD_READ_BLOCK, addr);
+    // Always a whole block: the length is fixed on high capacity cards, and
+    // set once by init() on the others. Only the requested part is kept.
+    send_command(CMD_READ_BLOCK, to_card(addr - offset));
     res = get_response(scratch, 1);
     if (res) {
         error(CMD_READ_BLOCK, res);
@@ -232,33 +321,27 @@ sd::read_block(uint32_t addr, uint8_t *buf, size_t size) {
         return 0;
     }
 
-    return read_data(buf, size);
+    return read_data(buf, size, offset, BLOCK_SIZE - offset - size);
 }
 
 
 /**
- * @par Implementation Notes:
+ * Send a block write: command, data, and CRC
+ *
+ * Shared by write_block(), write_block_pt() and write_sector(). Returns once
+ * the card has answered with its data response; the card may still be busy
+ * programming.
+ *
+ * @param arg   the CMD24 argument, from to_card() or to_card_block()
+ *
+ * @return 1 if the card accepted the data, 0 otherwise
  */
-uint8_t
-sd::write_block(uint32_t addr, const uint8_t *data, size_t size) {
+static uint8_t
+write_block_send(uint32_t arg, const uint8_t *data, size_t size) {
     uint8_t res;
-    uint8_t func_res = 1;
-    uint16_t i;
-    uint16_t crc;
-
-    crc = crc16(data, (uint32_t) size);
-
-    // Set the block length... won't work on SDHC
-    send_command(CMD_SET_BLOCKLEN, BLOCK_SIZE);
-    res = get_response(scratch, 1);
-    if (res) {
-        error(CMD_SET_BLOCKLEN, res);
-        decode_r1(res);
-        return 0;
-    }
 
     // Tell it we want to write
-    send_command(CMD_WRITE_BLOCK, addr);
+    send_command(CMD_WRITE_BLOCK, arg);
     res = get_response(scratch, 1);
     if (res) {
         error(CMD_WRITE_BLOCK, res);
@@ -266,35 +349,56 @@ sd::write_block(uint32_t addr, const uint8_t *data, size_t size) {
         return 0;
     }
 
-    gpio::low(_ss);
+    spi::begin(_dev);
 
     // Send "Start Block" byte
     spi::trx_byte(START_BLOCK);
 
-    // Send data
-    spi::write_block(data, size);
-
-    // Fill empty space
-    for (i = size; i < BLOCK_SIZE; i++) {
-        spi::trx_byte(FILL_BYTE);
-    }
+    // Send data, fill and CRC
+    send_data(data, size);
 
-    // Send CRC (recalc for fill bytes
-    crc = crc16_fill(crc, FILL_BYTE, BLOCK_SIZE - size);
-    spi::trx_byte((uint8_t) (crc >> 8));
-    spi::trx_byte((uint8_t) crc);
-
-    gpio::high(_ss);
+    spi::end(_dev);
 
     // Response?
     res = get_response(scratch, 1);
     if ((res & 0x0F) != 0x05) {
+        SAVR_TRACE(trace::EV_SD_DATA_REJECT, res);
         printf_P(PSTR("Error: Data rejected (%02hX)\n"), res);
         decode_data_res(res);
-        func_res = 0;
+        return 0;
     }
 
-    gpio::low(_ss);
+    return 1;
+}
+
+
+/**
+ * Check once if the card has finished programming
+ *
+ * The card holds its output low while busy. It keeps programming with the
+ * slave select released, so the bus is free between checks.
+ */
+static bool
+card_ready() {
+    spi::begin(_dev);
+    uint8_t res = spi::trx_byte(0xFF);
+    spi::end(_dev);
+    return res == NO_RESPONSE;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+uint8_t
+sd::write_block(uint32_t addr, const uint8_t *data, size_t size) {
+    uint8_t res;
+    uint8_t func_res;
+    uint16_t i;
+
+    func_res = write_block_send(to_card(addr), data, size);
+
+    spi::begin(_dev);
 
     // Wait for completion
     i = 0;
@@ -302,8 +406,9 @@ sd::write_block(uint32_t addr, const uint8_t *data, size_t size) {
         res = spi::trx_byte(0xFF);
         i++;
     } while (res != NO_RESPONSE && i < 50000);
+    SAVR_TRACE(trace::EV_SD_BUSY, i);
 
-    gpio::high(_ss);
+    spi::end(_dev);
 
     // Did it take a crazy amount of time?
     if (res != NO_RESPONSE) {
@@ -315,6 +420,74 @@ sd::write_block(uint32_t addr, const uint8_t *data, size_t size) {
 }
 
 
+/**
+ * @par Implementation Notes:
+ * The command and data go out in one step, since they take the SPI bus for
+ * only a few hundred microseconds. Only the programming time, which can run
+ * to hundreds of milliseconds, is waited on, and only if the card took the
+ * data.
+ */
+pt::State
+sd::write_block_pt(pt::Pt *self, uint32_t addr, const uint8_t *data,
+                   size_t size, uint8_t &result) {
+    PT_BEGIN(self);
+
+    result = write_block_send(to_card(addr), data, size);
+
+    if (result) {
+        PT_WAIT_UNTIL_TIMEOUT(self, card_ready(), WRITE_TIMEOUT_MS);
+        if (PT_TIMED_OUT(self)) {
+            error(0xFF, 0);
+            result = 0;
+        }
+    }
+
+    PT_END(self);
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+uint8_t
+sd::read_sector(uint32_t block, uint8_t *buf) {
+    uint8_t res;
+
+    send_command(CMD_READ_BLOCK, to_card_block(block));
+    res = get_response(scratch, 1);
+    if (res) {
+        error(CMD_READ_BLOCK, res);
+        decode_r1(res);
+        return 0;
+    }
+
+    return read_data(buf, BLOCK_SIZE);
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+uint8_t
+sd::write_sector(uint32_t block, const uint8_t *data) {
+    uint8_t res;
+    bool ready;
+
+    res = write_block_send(to_card_block(block), data, BLOCK_SIZE);
+
+    spi::begin(_dev);
+    ready = wait_ready();
+    spi::end(_dev);
+
+    if (!ready) {
+        error(CMD_WRITE_BLOCK, 0);
+        return 0;
+    }
+
+    return res;
+}
+
+
 /**
  * @par Implementation Notes:
  */
@@ -322,7 +495,7 @@ uint8_t
 sd::erase_block(uint32_t addr, uint32_t size) {
     uint8_t res;
 
-    send_command(CMD_ERASE_BLOCK_START, addr);
+    send_command(CMD_ERASE_BLOCK_START, to_card(addr));
     res = get_response(scratch, 1);
     if (res) {
         error(CMD_ERASE_BLOCK_START, res);
@@ -330,7 +503,7 @@ sd::erase_block(uint32_t addr, uint32_t size) {
         return 0;
     }
 
-    send_command(CMD_ERASE_BLOCK_END, addr + size);
+    send_command(CMD_ERASE_BLOCK_END, to_card(addr + size));
     res = get_response(scratch, 1);
     if (res) {
         error(CMD_ERASE_BLOCK_END, res);
@@ -350,12 +523,197 @@ sd::erase_block(uint32_t addr, uint32_t size) {
     // Optionally, the card will send a busy token (response R1b)
     // Wait until a non-zero response is sent back, indicating
     // that the erase is complete
-    gpio::low(_ss);
+    spi::begin(_dev);
     while (spi::trx_byte(0xFF) == 0) {
         // Do nothing
     }
-    gpio::high(_ss);
+    spi::end(_dev);
+
+    return 1;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The card stays selected until read_end(), so the bus is held for the
+ * whole stream.
+ */
+uint8_t
+sd::read_begin(uint32_t block) {
+    uint8_t res;
+
+    if (_stream != STREAM_NONE) {
+        return 0;
+    }
+
+    spi::begin(_dev);
+    send_frame(CMD_READ_MULTIPLE_BLOCK, to_card_block(block));
+    res = poll_response();
+    if (res) {
+        spi::end(_dev);
+        error(CMD_READ_MULTIPLE_BLOCK, res);
+        decode_r1(res);
+        return 0;
+    }
+
+    _stream = STREAM_READ;
+    return 1;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * Each block is a data token, 512 bytes and a CRC, with only the access
+ * time in between; there is no command overhead.
+ */
+uint8_t
+sd::read_next(uint8_t *buf) {
+    uint8_t res;
+    uint16_t i = 0;
+
+    if (_stream != STREAM_READ) {
+        return 0;
+    }
+
+    do {
+        res = spi::trx_byte(0xFF);
+    } while (res == NO_RESPONSE && ++i < DATA_TOKEN_POLLS);
+
+    if (res != START_BLOCK) {
+        error(CMD_READ_MULTIPLE_BLOCK, res);
+        decode_data_err(res);
+        return 0;
+    }
+
+    if (!receive_data(buf, BLOCK_SIZE, 0, 0)) {
+        error(CMD_READ_MULTIPLE_BLOCK, 0);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * CMD12 can cut a block short. The byte after it is a stuff byte (taken by
+ * send_frame()), then R1, then busy.
+ */
+uint8_t
+sd::read_end() {
+    uint8_t res;
+
+    if (_stream != STREAM_READ) {
+        return 0;
+    }
+
+    send_frame(CMD_STOP_TRANSMISSION, 0);
+    res = poll_response();
+    bool ready = wait_ready();
+
+    spi::end(_dev);
+    _stream = STREAM_NONE;
+
+    if (res || !ready) {
+        error(CMD_STOP_TRANSMISSION, res);
+        return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * ACMD23 is only a hint. A card that rejects it is still written to.
+ */
+uint8_t
+sd::write_begin(uint32_t block, uint32_t pre_erase) {
+    uint8_t res;
+
+    if (_stream != STREAM_NONE) {
+        return 0;
+    }
+
+    if (pre_erase) {
+        send_command(APP_CMD, 0);
+        get_response(scratch, 1);
+        send_command(SD_SET_WR_BLK_ERASE_COUNT, pre_erase & 0x7FFFFF);
+        res = get_response(scratch, 1);
+        if (res) {
+            error(SD_SET_WR_BLK_ERASE_COUNT, res);
+        }
+    }
+
+    spi::begin(_dev);
+    send_frame(CMD_WRITE_MULTIPLE_BLOCK, to_card_block(block));
+    res = poll_response();
+    if (res) {
+        spi::end(_dev);
+        error(CMD_WRITE_MULTIPLE_BLOCK, res);
+        decode_r1(res);
+        return 0;
+    }
+
+    _stream = STREAM_WRITE;
+    return 1;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The card buffers incoming blocks, so the busy time after each is short
+ * next to a single-block write.
+ */
+uint8_t
+sd::write_next(const uint8_t *data) {
+    uint8_t res;
+
+    if (_stream != STREAM_WRITE) {
+        return 0;
+    }
+
+    spi::trx_byte(0xFF);
+    spi::trx_byte(START_BLOCK_MULTI);
+    send_data(data, BLOCK_SIZE);
+
+    res = spi::trx_byte(0xFF);
+    if ((res & 0x1F) != 0x05) {
+        SAVR_TRACE(trace::EV_SD_DATA_REJECT, res);
+        error(CMD_WRITE_MULTIPLE_BLOCK, res);
+        decode_data_res(res);
+        wait_ready();
+        return 0;
+    }
+
+    if (!wait_ready()) {
+        error(CMD_WRITE_MULTIPLE_BLOCK, 0);
+        return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+uint8_t
+sd::write_end() {
+    if (_stream != STREAM_WRITE) {
+        return 0;
+    }
+
+    spi::trx_byte(0xFF);
+    spi::trx_byte(STOP_TRAN);
+    spi::trx_byte(0xFF);
+    bool ready = wait_ready();
 
+    spi::end(_dev);
+    _stream = STREAM_NONE;
+
+    if (!ready) {
+        error(CMD_WRITE_MULTIPLE_BLOCK, 0);
+        return 0;
+    }
     return 1;
 }
 
@@ -415,11 +773,29 @@ check_for_card(void) {
  */
 void
 send_command(uint8_t command, uint32_t arg) {
+    spi::begin(_dev);
+    send_frame(command, arg);
+    spi::end(_dev);
+}
+
+
+/**
+ * Sends a command frame, with the card already selected
+ *
+ * Followed by one clock byte, which is never the response (N_CR is at
+ * least one byte), and is the stuff byte after a CMD12.
+ *
+ * @param command the command to send
+ * @param arg the 32-bit argument to send with the command
+ */
+void
+send_frame(uint8_t command, uint32_t arg) {
     uint8_t temp[6]; // Block of data to send
     uint8_t i;
 
     // command is 0 1 x x x x x x
     command &= 0x3F;
+    SAVR_TRACE(trace::EV_SD_CMD, (command << 8) | (uint8_t) arg);
     command |= 0x40;
     temp[0] = command;
 
@@ -433,19 +809,97 @@ send_command(uint8_t command, uint32_t arg) {
     temp[5] = 0;
     temp[5] = (crc7(temp, 5) << 1) | 0x01;
 
-    //printf(" Sending command:");
-    //for(i=0; i<6; i++) {
-    //    printf(" %02X", temp[i]);
-    //}
-    //printf("\n");
-
-    gpio::low(_ss);
-
     spi::trx_byte(0xFF);
     spi::write_block(temp, 6);
     spi::trx_byte(0xFF);
+}
+
+
+/**
+ * Polls for an R1 response, with the card already selected
+ *
+ * @return the response, or NO_RESPONSE after 20 tries
+ */
+uint8_t
+poll_response() {
+    uint8_t res = NO_RESPONSE;
+    uint8_t i = 0;
 
-    gpio::high(_ss);
+    while (i < 20 && res == NO_RESPONSE) {
+        i++;
+        res = spi::trx_byte(0xFF);
+    }
+    SAVR_TRACE(trace::EV_SD_RESP, (i << 8) | res);
+    return res;
+}
+
+
+/**
+ * Waits for the card to stop signalling busy, with the card selected
+ *
+ * @return true if the card is ready, false on timeout
+ */
+bool
+wait_ready() {
+    uint32_t i = 0;
+    uint8_t res;
+
+    do {
+        res = spi::trx_byte(0xFF);
+    } while (res != NO_RESPONSE && ++i < READY_POLLS);
+
+    SAVR_TRACE(trace::EV_SD_BUSY, i > UINT16_MAX ? UINT16_MAX : i);
+    return res == NO_RESPONSE;
+}
+
+
+/**
+ * Converts a byte address to a command argument
+ *
+ * High capacity cards take block numbers, others byte addresses.
+ */
+uint32_t
+to_card(uint32_t addr) {
+    return _high_capacity ? addr / BLOCK_SIZE : addr;
+}
+
+
+/**
+ * Converts a block number to a command argument
+ */
+uint32_t
+to_card_block(uint32_t block) {
+    return _high_capacity ? block : block * BLOCK_SIZE;
+}
+
+
+/**
+ * Repeats an operating condition command until the card leaves idle
+ *
+ * @param command   CMD_SEND_OP_COND, or SD_SEND_OP_COND (sent as ACMD41)
+ * @param arg       the command argument
+ *
+ * @return the last R1 response, 0 once the card is ready
+ */
+uint8_t
+wait_op_cond(uint8_t command, uint32_t arg) {
+    uint8_t res;
+    uint16_t i = 0;
+
+    do {
+        if (command == SD_SEND_OP_COND) {
+            send_command(APP_CMD, 0);
+            res = get_response(scratch, 1);
+            if (res & R1_ILLEGAL_CMD) {
+                return res;
+            }
+        }
+        send_command(command, arg);
+        res = get_response(scratch, 1);
+        i++;
+    } while (res == R1_IDLE && i < INIT_POLLS);
+
+    return res;
 }
 
 
@@ -468,13 +922,14 @@ get_response(uint8_t *buf, uint16_t length) {
     uint8_t resx = NO_RESPONSE;
     uint8_t i = 0;
 
-    gpio::low(_ss);
+    spi::begin(_dev);
 
     while (i < 20 && res == NO_RESPONSE) {
         i++;
         res = spi::trx_byte(0xFF);
     }
     //printf("    Resp: %02hX", res);
+    SAVR_TRACE(trace::EV_SD_RESP, (i << 8) | res);
     buf[0] = res;
 
     // Read the rest of the response, up to length
@@ -486,7 +941,7 @@ get_response(uint8_t *buf, uint16_t length) {
 
     //printf("\n");
 
-    gpio::high(_ss);
+    spi::end(_dev);
 
     return res;
 }
@@ -500,18 +955,22 @@ get_response(uint8_t *buf, uint16_t length) {
  * valid START_BLOCK (0xFE). Will wait for 100 bytes
  * for a valid start or error token.
  *
+ * The skip and trail bytes around it are clocked in and dropped, then
+ * the data CRC is read and checked.
+ *
  * @param buf a pointer to the destination buffer
  * @param length the number of bytes to read (16bit)
+ * @param skip the number of leading bytes to drop
+ * @param trail the number of bytes to drop after the buffer
  *
  * @return 1 if sucessful, 0 otherwise.
  */
 uint8_t
-read_data(uint8_t *buf, uint16_t length) {
+read_data(uint8_t *buf, uint16_t length, uint16_t skip, uint16_t trail) {
     uint8_t res = 0;
-    uint16_t i = 0;
-    uint16_t retryCount = 100;
+    uint16_t retryCount = DATA_TOKEN_POLLS;
 
-    gpio::low(_ss);
+    spi::begin(_dev);
 
     // Find data start, or error token
     do {
@@ -519,19 +978,112 @@ read_data(uint8_t *buf, uint16_t length) {
     } while (res == NO_RESPONSE && retryCount--);
 
     if (res != START_BLOCK) {
+        spi::end(_dev);
         error(0xFF, res);
         decode_data_err(res);
         return 0;
     }
 
     // Data is comin our way...
-    for (i = 0; i < length; i++) {
-        buf[i] = spi::trx_byte(0xFF);
+    res = receive_data(buf, length, skip, trail);
+
+    spi::end(_dev);
+
+    if (!res) {
+        error(0xFF, 0);
     }
+    return res;
+}
 
-    gpio::high(_ss);
 
-    return 1;
+/**
+ * Sends a data block, padding and its CRC
+ *
+ * The start token must already have been sent. The block is padded with
+ * FILL_BYTE up to BLOCK_SIZE.
+ *
+ * @param data a pointer to the source data
+ * @param size the number of bytes of data, at most BLOCK_SIZE
+ */
+void
+send_data(const uint8_t *data, size_t size) {
+    uint16_t crc;
+
+#ifdef SD_USE_CRC
+    crc = spi::write_block_crc(data, size, 0);
+#else
+    spi::write_block(data, size);
+    crc = 0;
+#endif
+
+    // Fill empty space
+    for (; size < BLOCK_SIZE; size++) {
+        spi::trx_byte(FILL_BYTE);
+#ifdef SD_USE_CRC
+        crc = _crc_xmodem_update(crc, FILL_BYTE);
+#endif
+    }
+
+    spi::trx_byte((uint8_t) (crc >> 8));
+    spi::trx_byte((uint8_t) crc);
+}
+
+
+/**
+ * Receives a data block after its start token, and checks its CRC
+ *
+ * @param buf a pointer to the destination buffer
+ * @param length the number of bytes to keep
+ * @param skip the number of leading bytes to drop
+ * @param trail the number of bytes to drop after the buffer
+ *
+ * @return true if the CRC matched (or CRCs are off), false otherwise
+ */
+bool
+receive_data(uint8_t *buf, uint16_t length, uint16_t skip, uint16_t trail) {
+    uint16_t crc;
+
+    crc = clock_bytes(0xFF, skip, 0);
+#ifdef SD_USE_CRC
+    crc = spi::read_block_crc(buf, length, 0xFF, crc);
+#else
+    spi::read_block(buf, length, 0xFF);
+#endif
+    crc = clock_bytes(0xFF, trail, crc);
+
+    // Running the CRC over its own value leaves zero
+    crc = clock_bytes(0xFF, 2, crc);
+
+#ifdef SD_USE_CRC
+    if (crc) {
+        printf_P(PSTR("Error: Data CRC\n"));
+        return false;
+    }
+#endif
+    return true;
+}
+
+
+/**
+ * Clocks a byte out a number of times, adding what comes back to a CRC
+ *
+ * @param value the byte to send
+ * @param count the number of times to send it
+ * @param crc the CRC so far
+ *
+ * @return the updated CRC, or crc unchanged without SD_USE_CRC
+ */
+uint16_t
+clock_bytes(uint8_t value, uint16_t count, uint16_t crc) {
+    while (count--) {
+        uint8_t in = spi::trx_byte(value);
+#ifdef SD_USE_CRC
+        crc = _crc_xmodem_update(crc, in);
+#else
+        (void) in;
+#endif
+    }
+    return crc;
 }
 
 
@@ -546,6 +1098,7 @@ read_data(uint8_t *buf, uint16_t length) {
  */
 void
 error(uint8_t cmd, uint8_t res) {
+    SAVR_TRACE(trace::EV_SD_ERROR, (cmd << 8) | res);
     printf_P(PSTR("  Error: cmd=%02hX, res=%02hX\n"), cmd, res);
 }
 
@@ -657,11 +1210,12 @@ decode_data_err(uint8_t res) {
         printf_P(PSTR("Range\n"));
 }
 
-#ifdef SD_USE_CRC
-
 /**
  * A simple crc7 calculation
  *
+ * Commands always carry a real CRC, even with SD_NO_CRC: the card checks
+ * CMD0 and CMD8 whatever the CRC setting.
+ *
  * @param bytes a pointer to the source data
  * @param length the length of the source data (32bit)
  *
@@ -671,57 +1225,3 @@ uint8_t
 crc7(const uint8_t *bytes, size_t length) {
     return crc::crc_8(bytes, length, 0, 0x09 << 1) >> 1;
 }
-
-
-/**
- * A simple crc16 calculation (Xmodem)
- *
- * @param bytes   a pointer to the source data
- * @param length  the length of the source data
- *
- * @return the resultant CRC (16bit)
- */
-uint16_t
-crc16(const uint8_t *bytes, size_t length) {
-    return crc::crc_16(bytes, length, 0, 0x1021);
-}
-
-
-/**
- * Continues a crc16 (Xmodem) check.
- *
- * Allows you to calculate the crc for a constant
- * stream of bytes.
- *
- * @param crc the starting CRC
- * @param const_value the constant byte to use
- * @param length the number of bytes to run through the CRC
- *
- * @return the resultant CRC (16bit)
- */
-uint16_t
-crc16_fill(uint16_t crc, uint8_t const_value, size_t length) {
-    while (length-- > 0) {
-        crc = crc::crc_16(&const_value, 1, crc, 0x1021);
-    }
-    return crc;
-}
-
-#else
-
-uint8_t
-crc7(const uint8_t * bytes, size_t length) {
-    return 0x4A;
-}
-
-uint16_t
-crc16(const uint8_t * data, size_t length) {
-    return 0xFFFF;
-}
-
-uint16_t
-crc16_fill(uint16_t crc, uint8_t const_value, size_t length) {
-    return 0xFFFF;
-}
-
-#endif
@@ -0,0 +1,220 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file sd_cache.cpp
+ *
+ * Write-back block cache for the SD card
+ *
+ * Kept apart from sd.cpp so that the slot buffers only take RAM when the
+ * cache is used.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <savr/sd.h>
+
+using namespace savr;
+
+#ifndef SD_CACHE_SLOTS
+#define SD_CACHE_SLOTS 2
+#endif
+
+static_assert(SD_CACHE_SLOTS > 0 && SD_CACHE_SLOTS <= 16,
+              "SD_CACHE_SLOTS must be 1 to 16");
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 512;
+
+constexpr uint8_t SLOT_VALID = 0x01;
+constexpr uint8_t SLOT_DIRTY = 0x02;
+
+typedef struct {
+    uint32_t block;
+    uint8_t flags;
+} Slot;
+
+uint8_t _data[SD_CACHE_SLOTS][BLOCK_SIZE];
+Slot _slots[SD_CACHE_SLOTS];
+uint8_t _order[SD_CACHE_SLOTS];         ///< Slot indexes, most recent first
+bool _ordered;                          ///< _order has been filled in
+sd::CacheStats _stats;
+
+
+/**
+ * Moves the slot at position pos of _order to the front
+ */
+uint8_t
+touch(uint8_t pos) {
+    uint8_t slot = _order[pos];
+    for (; pos > 0; pos--) {
+        _order[pos] = _order[pos - 1];
+    }
+    _order[0] = slot;
+    return slot;
+}
+
+
+/**
+ * Writes a slot back to the card if it is dirty
+ */
+uint8_t
+write_back(uint8_t slot) {
+    Slot &s = _slots[slot];
+    if ((s.flags & (SLOT_VALID | SLOT_DIRTY)) != (SLOT_VALID | SLOT_DIRTY)) {
+        return 1;
+    }
+    if (!sd::write_sector(s.block, _data[slot])) {
+        return 0;
+    }
+    s.flags &= ~SLOT_DIRTY;
+    _stats.writebacks++;
+    return 1;
+}
+
+
+/**
+ * Finds or loads a block, making it the most recently used
+ *
+ * _order is searched front to back, so the most recently used blocks are
+ * found first. With a handful of slots this beats any index.
+ *
+ * @param block the block number
+ * @param load  read the block from the card on a miss
+ *
+ * @return the slot, or SD_CACHE_SLOTS on a card error
+ */
+uint8_t
+lookup(uint32_t block, bool load) {
+    uint8_t pos;
+    uint8_t slot;
+
+    if (!_ordered) {
+        for (pos = 0; pos < SD_CACHE_SLOTS; pos++) {
+            _order[pos] = pos;
+        }
+        _ordered = true;
+    }
+
+    for (pos = 0; pos < SD_CACHE_SLOTS; pos++) {
+        Slot &s = _slots[_order[pos]];
+        if ((s.flags & SLOT_VALID) && s.block == block) {
+            break;
+        }
+    }
+
+    if (pos < SD_CACHE_SLOTS) {
+        _stats.hits++;
+        return touch(pos);
+    }
+
+    // Reuse the least recently used slot
+    slot = _order[SD_CACHE_SLOTS - 1];
+    if (!write_back(slot)) {
+        return SD_CACHE_SLOTS;
+    }
+    _slots[slot].flags = 0;
+    if (load) {
+        _stats.misses++;
+        if (!sd::read_sector(block, _data[slot])) {
+            return SD_CACHE_SLOTS;
+        }
+    }
+    _slots[slot].block = block;
+    _slots[slot].flags = SLOT_VALID;
+    return touch(SD_CACHE_SLOTS - 1);
+}
+
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+uint8_t *
+sd::cache_block(uint32_t block, bool dirty) {
+    uint8_t slot = lookup(block, true);
+
+    if (slot == SD_CACHE_SLOTS) {
+        return NULL;
+    }
+    if (dirty) {
+        _slots[slot].flags |= SLOT_DIRTY;
+    }
+    return _data[slot];
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+uint8_t *
+sd::cache_new(uint32_t block) {
+    uint8_t slot = lookup(block, false);
+
+    if (slot == SD_CACHE_SLOTS) {
+        return NULL;
+    }
+    _slots[slot].flags |= SLOT_DIRTY;
+    return _data[slot];
+}
+
+
+/**
+ * @par Implementation Notes:
+ * Goes on past a failed write, so one bad block doesn't hold the rest back.
+ */
+uint8_t
+sd::flush() {
+    uint8_t res = 1;
+    for (uint8_t slot = 0; slot < SD_CACHE_SLOTS; slot++) {
+        if (!write_back(slot)) {
+            res = 0;
+        }
+    }
+    return res;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+void
+sd::cache_invalidate() {
+    for (uint8_t slot = 0; slot < SD_CACHE_SLOTS; slot++) {
+        _slots[slot].flags = 0;
+    }
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+sd::CacheStats
+sd::cache_stats(bool reset) {
+    CacheStats stats = _stats;
+    if (reset) {
+        _stats = CacheStats();
+    }
+    return stats;
+}
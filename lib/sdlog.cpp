@@ -0,0 +1,421 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file sdlog.cpp
+ *
+ * Append-only record log on raw SD blocks
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <savr/crc.h>
+#include <savr/sd.h>
+#include <savr/sdlog.h>
+
+using namespace savr;
+
+namespace {
+
+constexpr uint16_t PAGE_SIZE = 512;
+
+// Page layout
+constexpr uint8_t PAGE_MAGIC = 0;
+constexpr uint8_t PAGE_SEQ = 2;
+constexpr uint8_t PAGE_RECORD_SIZE = 6;
+constexpr uint8_t PAGE_COUNT = 8;
+constexpr uint8_t PAGE_RECORDS = 10;
+constexpr uint16_t PAGE_CRC = PAGE_SIZE - 2;
+
+constexpr uint16_t MAGIC = 'S' | 'L' << 8;
+constexpr uint16_t CRC_POLY = 0x1021;
+
+static_assert(PAGE_RECORDS + sdlog::MAX_RECORD == PAGE_CRC,
+              "MAX_RECORD does not match the page layout");
+
+uint8_t _page[PAGE_SIZE];
+
+uint32_t _first;        ///< First block of the range
+uint32_t _blocks;       ///< Blocks in the range
+uint32_t _origin;       ///< A sequence number that goes in block _first
+uint32_t _oldest;       ///< Oldest page
+uint32_t _head;         ///< Newest page, _oldest - 1 while empty
+uint32_t _buf_seq;      ///< Page in _page
+uint16_t _size;         ///< Record size
+uint16_t _capacity;     ///< Records per page
+uint16_t _head_count;   ///< Records in the newest page
+bool _buf_valid;        ///< _page holds page _buf_seq
+bool _dirty;            ///< _page has records not on the card
+
+
+uint16_t
+ld16(const uint8_t *p) {
+    return p[0] | (uint16_t) p[1] << 8;
+}
+
+
+uint32_t
+ld32(const uint8_t *p) {
+    return ld16(p) | (uint32_t) ld16(p + 2) << 16;
+}
+
+
+void
+st16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+}
+
+
+void
+st32(uint8_t *p, uint32_t value) {
+    st16(p, (uint16_t) value);
+    st16(p + 2, (uint16_t) (value >> 16));
+}
+
+
+bool
+empty() {
+    return (int32_t) (_head - _oldest) < 0;
+}
+
+
+/**
+ * Block holding a page
+ */
+uint32_t
+block_of(uint32_t seq) {
+    return _first + (seq - _origin + _blocks) % _blocks;
+}
+
+
+/**
+ * Reads a block of the range into _page and checks it is a log page
+ *
+ * @param slot  block within the range
+ * @param seq   set to the page's sequence number
+ *
+ * @return true for a good page
+ */
+bool
+probe(uint32_t slot, uint32_t &seq) {
+    uint16_t crc;
+
+    _buf_valid = false;
+    if (!sd::read_sector(_first + slot, _page)) {
+        return false;
+    }
+
+    crc = crc::crc_16(_page, PAGE_CRC, 0, CRC_POLY);
+    if (ld16(_page + PAGE_MAGIC) != MAGIC ||
+        _page[PAGE_CRC] != (uint8_t) (crc >> 8) ||
+        _page[PAGE_CRC + 1] != (uint8_t) crc) {
+        return false;
+    }
+
+    seq = ld32(_page + PAGE_SEQ);
+    return true;
+}
+
+
+/**
+ * Loads a page into _page
+ *
+ * @return true if the page is good, and of this log
+ */
+bool
+load(uint32_t seq) {
+    uint32_t found;
+
+    if (!probe(block_of(seq) - _first, found) || found != seq ||
+        ld16(_page + PAGE_RECORD_SIZE) != _size) {
+        return false;
+    }
+
+    _buf_seq = seq;
+    _buf_valid = true;
+    return true;
+}
+
+
+/**
+ * Writes _page, which holds the newest page, to the card
+ */
+uint8_t
+store() {
+    uint16_t crc;
+
+    st16(_page + PAGE_MAGIC, MAGIC);
+    st32(_page + PAGE_SEQ, _head);
+    st16(_page + PAGE_RECORD_SIZE, _size);
+    st16(_page + PAGE_COUNT, _head_count);
+
+    crc = crc::crc_16(_page, PAGE_CRC, 0, CRC_POLY);
+    _page[PAGE_CRC] = (uint8_t) (crc >> 8);
+    _page[PAGE_CRC + 1] = (uint8_t) crc;
+
+    if (!sd::write_sector(block_of(_head), _page)) {
+        return 0;
+    }
+    _dirty = false;
+    return 1;
+}
+
+
+/**
+ * Sets the record size, and the page capacity from it
+ */
+bool
+set_size(uint16_t record_size) {
+    if (!record_size || record_size > sdlog::MAX_RECORD) {
+        return false;
+    }
+    _size = record_size;
+    _capacity = sdlog::MAX_RECORD / record_size;
+    return true;
+}
+
+}
+
+
+/**
+ * @par Implementation Notes:
+ * Block i of the range holds page s0 + i for every i up to the newest page,
+ * where s0 is the page in the first block; past it are older pages (or
+ * none), which don't match. That makes a binary search for the last match.
+ *
+ * A bad first block is either an empty range, or the newest page torn as
+ * the log wrapped onto it. The last block tells the two apart; clear()
+ * spoils it first, so a clear() torn at the first block reads as empty.
+ *
+ * Likewise the block after the last match is either the oldest page of a
+ * wrapped log, or unused. If it is bad, it may be the newest page torn in a
+ * wrapped log, so the block after it is checked too.
+ */
+uint8_t
+sdlog::mount(uint32_t first, uint32_t blocks, uint16_t record_size) {
+    uint32_t s0;
+    uint32_t seq;
+    uint32_t lo;
+    uint32_t hi;
+
+    if (blocks < 2 || !set_size(record_size)) {
+        return 0;
+    }
+
+    _first = first;
+    _blocks = blocks;
+    _dirty = false;
+
+    if (!probe(0, s0)) {
+        if (!probe(blocks - 1, seq)) {
+            // Nothing here yet
+            _origin = 1;
+            _oldest = 1;
+            _head = 0;
+            _head_count = 0;
+            return 1;
+        }
+        lo = blocks - 1;
+        s0 = seq - lo;
+        _oldest = seq - blocks + 2;
+    } else {
+        lo = 0;
+        hi = blocks;
+        while (hi - lo > 1) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (probe(mid, seq) && seq == s0 + mid) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+
+        // Has it wrapped? Then the next block is the oldest page, unless
+        // it is a torn newest page and the oldest is one further on.
+        _oldest = s0;
+        if (lo + 1 < blocks) {
+            if (probe(lo + 1, seq)) {
+                if (seq == s0 + lo + 1 - blocks) {
+                    _oldest = seq;
+                }
+            } else if (lo + 2 < blocks && probe(lo + 2, seq) &&
+                       seq == s0 + lo + 2 - blocks) {
+                _oldest = seq;
+            }
+        }
+    }
+
+    _origin = s0;
+    _head = s0 + lo;
+    if (!load(_head)) {
+        return 0;
+    }
+    _head_count = ld16(_page + PAGE_COUNT);
+    if (_head_count > _capacity) {
+        return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+uint8_t
+sdlog::append(const void *record) {
+    if (empty() || _head_count == _capacity) {
+        // Start a new page, over the oldest if the range is full
+        if (!sync()) {
+            return 0;
+        }
+        _head++;
+        _head_count = 0;
+        if (_head - _oldest >= _blocks) {
+            _oldest = _head - _blocks + 1;
+        }
+        memset(_page, 0, PAGE_SIZE);
+        _buf_seq = _head;
+        _buf_valid = true;
+    } else if (!_buf_valid || _buf_seq != _head) {
+        if (!load(_head)) {
+            return 0;
+        }
+    }
+
+    memcpy(_page + PAGE_RECORDS + _head_count * _size, record, _size);
+    _head_count++;
+    _dirty = true;
+
+    if (_head_count == _capacity) {
+        return store();
+    }
+    return 1;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+uint8_t
+sdlog::sync() {
+    return _dirty ? store() : 1;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The empty page is numbered a whole range past the newest, so no old page
+ * can pass for the one after it, or for the oldest in a wrapped log.
+ *
+ * The last block is overwritten first. mount() falls back on it when the
+ * first block is bad, and a torn write of the empty page must not bring
+ * the old log back.
+ */
+uint8_t
+sdlog::clear(uint16_t record_size) {
+    if (!_blocks || !set_size(record_size)) {
+        return 0;
+    }
+
+    memset(_page, 0, PAGE_SIZE);
+    _buf_valid = false;
+    if (!sd::write_sector(_first + _blocks - 1, _page)) {
+        return 0;
+    }
+
+    _head += _blocks + 1;
+    _origin = _head;
+    _oldest = _head;
+    _head_count = 0;
+
+    memset(_page, 0, PAGE_SIZE);
+    _buf_seq = _head;
+    _buf_valid = true;
+    return store();
+}
+
+
+/**
+ * @par Implementation Notes:
+ * Every page but the newest is full.
+ */
+uint32_t
+sdlog::count() {
+    if (empty()) {
+        return 0;
+    }
+    return (_head - _oldest) * _capacity + _head_count;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+void
+sdlog::rewind(Reader &reader) {
+    reader.seq = _oldest;
+    reader.index = 0;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The newest page is read from the buffer, so records are seen as soon as
+ * they are appended. Any other page is loaded into it, after a sync().
+ */
+uint8_t
+sdlog::read(Reader &reader, void *record) {
+    uint16_t records;
+
+    for (;;) {
+        if (empty() || (int32_t) (reader.seq - _head) > 0) {
+            return 0;
+        }
+        if ((int32_t) (reader.seq - _oldest) < 0) {
+            reader.seq = _oldest;
+            reader.index = 0;
+        }
+
+        records = reader.seq == _head ? _head_count : _capacity;
+        if (reader.index < records) {
+            break;
+        }
+        if (reader.seq == _head) {
+            return 0;
+        }
+        reader.seq++;
+        reader.index = 0;
+    }
+
+    if (!_buf_valid || _buf_seq != reader.seq) {
+        if (!sync() || !load(reader.seq) ||
+            ld16(_page + PAGE_COUNT) < records) {
+            return 0;
+        }
+    }
+
+    memcpy(record, _page + PAGE_RECORDS + reader.index * _size, _size);
+    reader.index++;
+    return 1;
+}
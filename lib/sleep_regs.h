@@ -0,0 +1,60 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_sleep_regs_h_included_
+#define _savr_sleep_regs_h_included_
+
+/**
+ * @file sleep_regs.h
+ *
+ * Sleep mode bits, private to the library.
+ *
+ * The library sleeps in idle mode, but must leave the application's own
+ * choice of mode in place. Shared by clock.cpp and sci_usart.h.
+ */
+
+#include <avr/io.h>
+#include <avr/sleep.h>
+
+//! Sleep mode select bits in _SLEEP_CONTROL_REG
+#if defined(SM2)
+#define SLEEP_MODE_BITS (_BV(SM2) | _BV(SM1) | _BV(SM0))
+#else
+#define SLEEP_MODE_BITS (_BV(SM1) | _BV(SM0))
+#endif
+
+/**
+ * Get the sleep mode currently selected
+ */
+static inline uint8_t
+get_sleep_mode() {
+    return _SLEEP_CONTROL_REG & SLEEP_MODE_BITS;
+}
+
+/**
+ * Put back a mode from get_sleep_mode(). Interrupts must be disabled.
+ */
+static inline void
+restore_sleep_mode(uint8_t mode) {
+    _SLEEP_CONTROL_REG = (_SLEEP_CONTROL_REG & ~SLEEP_MODE_BITS) | mode;
+}
+
+#endif /* _savr_sleep_regs_h_included_ */
@@ -23,69 +23,19 @@
 #include <avr/sfr_defs.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/crc16.h>
 #include <stdio.h>
 
 #include <savr/cpp_pgmspace.h>
 #include <savr/spi.h>
 #include <savr/utils.h>
 #include <savr/gpio.h>
+#include <savr/prof.h>
+#include <savr/trace.h>
 
-using namespace savr;
-
-#if     ISAVR(ATmega8)      || \
-        ISAVR(ATmega48)     || ISAVR(ATmega88)      || ISAVR(ATmega168)     || \
-        ISAVR(ATmega48P)    || ISAVR(ATmega88P)     || ISAVR(ATmega168P)    || \
-        ISAVR(ATmega48PA)   || ISAVR(ATmega88PA)    || ISAVR(ATmega168PA)   || ISAVR(ATmega328P)
-#define SPI_SS   gpio::B2
-#define SPI_MOSI gpio::B3
-#define SPI_MISO gpio::B4
-#define SPI_SCK  gpio::B5
-
-#elif   ISAVR(ATmega16)     || \
-        ISAVR(ATmega32)     || \
-        ISAVR(ATmega644)    || \
-        ISAVR(ATmega8515)   || \
-        ISAVR(ATmega164P)   || ISAVR(ATmega324P)    || ISAVR(ATmega644P)    || \
-        ISAVR(ATmega164A)   || ISAVR(ATmega164PA)   || ISAVR(ATmega324A)    || ISAVR(ATmega324PA)   || \
-        ISAVR(ATmega644A)   || ISAVR(ATmega644PA)   || ISAVR(ATmega1284)    || ISAVR(ATmega1284P)
-#define SPI_SS   gpio::B4
-#define SPI_MOSI gpio::B5
-#define SPI_MISO gpio::B6
-#define SPI_SCK  gpio::B7
-
-// This fixes improper register/field names in avr-libc for the atmega324pa
-#ifndef SPI2X
-#define SPI2X SPI2X0
-#endif
-#ifndef SPR0
-#define SPR0 SPR00
-#endif
-#ifndef SPR1
-#define SPR1 SPR10
-#endif
-#ifndef SPCR
-#define SPCR SPCR0
-#endif
-#ifndef SPSR
-#define SPSR SPSR0
-#endif
-#ifndef SPE
-#define SPE SPE0
-#endif
-#ifndef MSTR
-#define MSTR MSTR0
-#endif
-#ifndef SPDR
-#define SPDR SPDR0
-#endif
-#ifndef SPIF
-#define SPIF SPIF0
-#endif
+#include "spi_regs.h"
 
-#else
-#warning Unsupported AVR target for SPI interface
-#define SAVR_NO_SPI
-#endif
+using namespace savr;
 
 #ifndef SAVR_NO_SPI
 
@@ -121,25 +71,259 @@ spi::ss_low() {
 }
 
 
+/**
+ * Check if the bus runs at fck/2, the rate the block kernels are timed for
+ */
+static inline bool
+at_full_speed() {
+    return (SPCR & (_BV(SPR1) | _BV(SPR0))) == 0 && (SPSR & _BV(SPI2X));
+}
+
+
+/**
+ * Delay helpers for the fck/2 kernels, in cycles
+ */
+#define SPI_DELAY_2 "rjmp .+0\n\t"
+#define SPI_DELAY_3 SPI_DELAY_2 "nop\n\t"
+#define SPI_DELAY_8 SPI_DELAY_2 SPI_DELAY_2 SPI_DELAY_2 SPI_DELAY_2
+#define SPI_DELAY_10 SPI_DELAY_8 SPI_DELAY_2
+
+/**
+ * Wait out the last byte of a kernel (12 cycles), then clear SPIF by
+ * reading SPSR and SPDR. Leaves the last byte received in %[in].
+ */
+#define SPI_KERNEL_TAIL                                                     \
+        "2:\n\t"                                                            \
+        "ldi %[tmp], 4\n\t"                                                 \
+        "3: dec %[tmp]\n\t"                                                 \
+        "brne 3b\n\t"                                                       \
+        "in %[tmp], %[spsr]\n\t"                                            \
+        "in %[in], %[spdr]\n\t"
+
+
+/**
+ * Send a block at fck/2
+ *
+ * A byte takes 16 cycles to shift out. The loop is counted to write SPDR
+ * every 18 cycles, never sooner, so there is no SPIF polling and no write
+ * collision. An interrupt can only make a write later, which is harmless.
+ */
+static void
+write_block_fast(const uint8_t *input, size_t length) {
+    uint8_t tmp, in;
+    asm volatile (
+        "ld %[in], Z+\n\t"
+        "1: out %[spdr], %[in]\n\t"       // 1
+        "sbiw %[len], 1\n\t"              // 2
+        "breq 2f\n\t"                     // 1
+        "ld %[in], Z+\n\t"                // 2
+        SPI_DELAY_10                        // 10
+        "rjmp 1b\n\t"                     // 2 = 18
+        SPI_KERNEL_TAIL
+        : [len] "+w" (length), [src] "+z" (input),
+          [tmp] "=&d" (tmp), [in] "=&r" (in)
+        : [spdr] "I" (_SFR_IO_ADDR(SPDR)), [spsr] "I" (_SFR_IO_ADDR(SPSR))
+        : "memory"
+    );
+}
+
+
+/**
+ * Receive a block at fck/2
+ *
+ * SPDR is read 17 cycles after the write that started the byte, then the
+ * next byte is started straight away. The receive side is double
+ * buffered, so reading first means an interrupt between the two can't
+ * let a newer byte overwrite the one being read.
+ */
+static void
+read_block_fast(uint8_t *output, size_t length, uint8_t filler) {
+    uint8_t tmp, in;
+    asm volatile (
+        "out %[spdr], %[fill]\n\t"        // @0
+        "sbiw %[len], 1\n\t"
+        "breq 2f\n\t"
+        SPI_DELAY_3                         // in lands at 17
+        "1:\n\t"
+        SPI_DELAY_10                        // 10
+        "in %[in], %[spdr]\n\t"           // 1
+        "out %[spdr], %[fill]\n\t"        // 1
+        "st X+, %[in]\n\t"                // 2
+        "sbiw %[len], 1\n\t"              // 2
+        "brne 1b\n\t"                     // 2 = 18
+        SPI_KERNEL_TAIL
+        "st X+, %[in]\n\t"
+        : [len] "+w" (length), [dst] "+x" (output),
+          [tmp] "=&d" (tmp), [in] "=&r" (in)
+        : [fill] "r" (filler),
+          [spdr] "I" (_SFR_IO_ADDR(SPDR)), [spsr] "I" (_SFR_IO_ADDR(SPSR))
+        : "memory"
+    );
+}
+
+
+/**
+ * Send and receive a block at fck/2; see read_block_fast()
+ */
+static void
+trx_block_fast(const uint8_t *input, uint8_t *output, size_t length) {
+    uint8_t tmp, in, out;
+    asm volatile (
+        "ld %[out], Z+\n\t"
+        "out %[spdr], %[out]\n\t"         // @0
+        "sbiw %[len], 1\n\t"
+        "breq 2f\n\t"
+        SPI_DELAY_3                         // in lands at 17
+        "1: ld %[out], Z+\n\t"            // 2
+        SPI_DELAY_8                         // 8
+        "in %[in], %[spdr]\n\t"           // 1
+        "out %[spdr], %[out]\n\t"         // 1
+        "st X+, %[in]\n\t"                // 2
+        "sbiw %[len], 1\n\t"              // 2
+        "brne 1b\n\t"                     // 2 = 18
+        SPI_KERNEL_TAIL
+        "st X+, %[in]\n\t"
+        : [len] "+w" (length), [src] "+z" (input), [dst] "+x" (output),
+          [tmp] "=&d" (tmp), [in] "=&r" (in), [out] "=&r" (out)
+        : [spdr] "I" (_SFR_IO_ADDR(SPDR)), [spsr] "I" (_SFR_IO_ADDR(SPSR))
+        : "memory"
+    );
+}
+
+
 /**
  * @par Implementation Notes:
+ * At fck/2 this is a cycle-counted kernel. Otherwise the next byte is
+ * loaded while the current one shifts, so only the SPIF poll is left
+ * between bytes.
  */
 void
 spi::write_block(const uint8_t *input, size_t length) {
-    size_t i = 0;
-    while (i < length)
-        spi::trx_byte(input[i++]);
+    SAVR_TRACE(trace::EV_SPI_WRITE, length);
+    if (length == 0) return;
+
+    if (at_full_speed()) {
+        write_block_fast(input, length);
+        return;
+    }
+
+    SPDR = *input++;
+    while (--length) {
+        uint8_t next = *input++;
+        while (!(SPSR & _BV(SPIF)));
+        SPDR = next;
+    }
+    while (!(SPSR & _BV(SPIF)));
+    (void) SPDR;
 }
 
 
 /**
  * @par Implementation Notes:
+ * See write_block(). The next byte is started before the received one is
+ * stored.
  */
 void
 spi::read_block(uint8_t *input, size_t length, uint8_t filler) {
-    size_t i = 0;
-    while (i < length)
-        input[i++] = spi::trx_byte(filler);
+    SAVR_TRACE(trace::EV_SPI_READ, length);
+    if (length == 0) return;
+
+    if (at_full_speed()) {
+        read_block_fast(input, length, filler);
+        return;
+    }
+
+    SPDR = filler;
+    while (--length) {
+        while (!(SPSR & _BV(SPIF)));
+        uint8_t in = SPDR;
+        SPDR = filler;
+        *input++ = in;
+    }
+    while (!(SPSR & _BV(SPIF)));
+    *input = SPDR;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * See write_block().
+ */
+void
+spi::trx_block(const uint8_t *input, uint8_t *output, size_t length) {
+    SAVR_TRACE(trace::EV_SPI_TRX, length);
+    if (length == 0) return;
+
+    if (at_full_speed()) {
+        trx_block_fast(input, output, length);
+        return;
+    }
+
+    SPDR = *input++;
+    while (--length) {
+        uint8_t next = *input++;
+        while (!(SPSR & _BV(SPIF)));
+        uint8_t in = SPDR;
+        SPDR = next;
+        *output++ = in;
+    }
+    while (!(SPSR & _BV(SPIF)));
+    *output = SPDR;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The next byte is started before the CRC of the last one is updated, so
+ * the update overlaps the shift. There is no counted kernel: at fck/2 the
+ * update takes longer than a byte, so the loop is CRC bound, but still
+ * well ahead of a separate pass over the buffer.
+ */
+uint16_t
+spi::write_block_crc(const uint8_t *input, size_t length, uint16_t crc) {
+    SAVR_TRACE(trace::EV_SPI_WRITE, length);
+    if (length == 0) return crc;
+
+    uint8_t last = *input++;
+    SPDR = last;
+    while (--length) {
+        uint8_t next = *input++;
+        crc = _crc_xmodem_update(crc, last);
+        while (!(SPSR & _BV(SPIF)));
+        SPDR = next;
+        last = next;
+    }
+    crc = _crc_xmodem_update(crc, last);
+    while (!(SPSR & _BV(SPIF)));
+    (void) SPDR;
+
+    return crc;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * See write_block_crc(). Each received byte is stored and added to the
+ * CRC after the next one has been started.
+ */
+uint16_t
+spi::read_block_crc(uint8_t *output, size_t length, uint8_t filler, uint16_t crc) {
+    SAVR_TRACE(trace::EV_SPI_READ, length);
+    if (length == 0) return crc;
+
+    SPDR = filler;
+    while (--length) {
+        while (!(SPSR & _BV(SPIF)));
+        uint8_t in = SPDR;
+        SPDR = filler;
+        *output++ = in;
+        crc = _crc_xmodem_update(crc, in);
+    }
+    while (!(SPSR & _BV(SPIF)));
+    uint8_t in = SPDR;
+    *output = in;
+
+    return _crc_xmodem_update(crc, in);
 }
 
 
@@ -148,6 +332,7 @@ spi::read_block(uint8_t *input, size_t length, uint8_t filler) {
  */
 uint8_t
 spi::trx_byte(uint8_t input) {
+    SAVR_PROFILE("spi::trx_byte");
     uint8_t status;
 
     SPDR = input;
@@ -180,6 +365,78 @@ highest_bit(uint8_t word) {
 }
 
 
+/**
+ * Find the table entry for the fastest clock at or below max_freq
+ */
+static uint8_t
+freq_cfg_index(uint32_t max_freq) {
+    uint8_t i = 0;
+    while (i < FREQ_CFG_SIZE - 1 && (F_CPU >> (i + 1)) > max_freq) {
+        i++;
+    }
+    return i;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * Unlike init(), the clock is rounded down, so a device is never run
+ * faster than it allows.
+ */
+spi::Device::Device(gpio::Pin ss, uint32_t max_freq, Mode mode) :
+    ss(ss), spcr(_BV(SPE) | _BV(MSTR) | mode), spsr(0) {
+
+    gpio::high(ss);
+    gpio::out(ss);
+    set_clock(max_freq);
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+void
+spi::Device::set_clock(uint32_t max_freq) {
+    uint8_t i = freq_cfg_index(max_freq);
+    spcr = (spcr & ~(_BV(SPR1) | _BV(SPR0))) | pgm_read_byte(&reg_freq_cfg[i].spcr);
+    spsr = pgm_read_byte(&reg_freq_cfg[i].spsr);
+}
+
+
+/**
+ * @par Implementation Notes:
+ * SPI2X is the only writable bit of SPSR; the rest are status.
+ */
+void
+spi::configure(const Device &device) {
+    if (SPCR != device.spcr) {
+        SPCR = device.spcr;
+    }
+    if ((SPSR & _BV(SPI2X)) != device.spsr) {
+        SPSR = device.spsr;
+    }
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+void
+spi::begin(const Device &device) {
+    configure(device);
+    gpio::low(device.ss);
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+void
+spi::end(const Device &device) {
+    gpio::high(device.ss);
+}
+
+
 /**
  * @par Implementation Notes:
  */
@@ -220,8 +477,8 @@ spi::init(uint32_t spiFreq) {
      *   SPI enabled, master mode, fck/2, MSB first
      *   Mode 0
      */
-    SPCR |= _BV(SPE) | _BV(MSTR) | pgm_read_byte(&reg_freq_cfg[div_exp].spcr);
-    SPSR |= pgm_read_byte(&reg_freq_cfg[div_exp].spsr);
+    SPCR = _BV(SPE) | _BV(MSTR) | pgm_read_byte(&reg_freq_cfg[div_exp].spcr);
+    SPSR = pgm_read_byte(&reg_freq_cfg[div_exp].spsr);
 }
 
 #endif
@@ -0,0 +1,142 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file spi_async.cpp
+ *
+ * Interrupt-driven SPI transfers
+ *
+ * Kept apart from spi.cpp so that the SPI interrupt vector is only linked
+ * in when transfer_async() is used.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include <savr/spi.h>
+#include <savr/trace.h>
+
+#include "spi_regs.h"
+
+using namespace savr;
+
+#ifndef SAVR_NO_SPI
+
+namespace {
+
+const uint8_t *_tx;
+uint8_t *_rx;
+size_t _length;
+size_t _index;
+uint8_t _filler;
+spi::Callback _callback;
+void *_arg;
+volatile bool _busy;
+
+}
+
+
+/**
+ * @par Implementation Notes:
+ * SPIF is cleared (status, then data register) before enabling the
+ * interrupt, so a flag left over from a blocking call doesn't fire it early.
+ */
+bool
+spi::transfer_async(const uint8_t *tx, uint8_t *rx, size_t length,
+                    Callback callback, void *arg, uint8_t filler) {
+    if (_busy) {
+        return false;
+    }
+
+    SAVR_TRACE(trace::EV_SPI_ASYNC, length);
+
+    if (length == 0) {
+        if (callback) callback(arg);
+        return true;
+    }
+
+    _tx = tx;
+    _rx = rx;
+    _length = length;
+    _index = 0;
+    _filler = filler;
+    _callback = callback;
+    _arg = arg;
+    _busy = true;
+
+    (void) SPSR;
+    (void) SPDR;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        SPCR |= _BV(SPIE);
+        SPDR = tx ? tx[0] : filler;
+    }
+    return true;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+bool
+spi::busy() {
+    return _busy;
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+void
+spi::wait() {
+    while (_busy);
+}
+
+
+/**
+ * SPI transfer complete
+ *
+ * The next byte goes out before the received one is stored, to keep the
+ * gap on the bus short.
+ */
+ISR(SPI_STC_vect) {
+    uint8_t in = SPDR;
+    size_t i = _index;
+    size_t next = i + 1;
+
+    if (next < _length) {
+        SPDR = _tx ? _tx[next] : _filler;
+        _index = next;
+        if (_rx) _rx[i] = in;
+        return;
+    }
+
+    if (_rx) _rx[i] = in;
+    SPCR &= ~_BV(SPIE);
+    _busy = false;
+
+    if (_callback) {
+        _callback(_arg);
+    }
+}
+
+#endif
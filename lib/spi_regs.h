@@ -0,0 +1,99 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+#ifndef _savr_spi_regs_h_included_
+#define _savr_spi_regs_h_included_
+
+/**
+ * @file spi_regs.h
+ *
+ * SPI pins and register names per target, private to the library.
+ *
+ * Shared by spi.cpp and spi_async.cpp.
+ */
+
+#include <avr/io.h>
+
+#include <savr/gpio.h>
+#include <savr/utils.h>
+
+#if     ISAVR(ATmega8)      || \
+        ISAVR(ATmega48)     || ISAVR(ATmega88)      || ISAVR(ATmega168)     || \
+        ISAVR(ATmega48P)    || ISAVR(ATmega88P)     || ISAVR(ATmega168P)    || \
+        ISAVR(ATmega48PA)   || ISAVR(ATmega88PA)    || ISAVR(ATmega168PA)   || ISAVR(ATmega328P)
+#define SPI_SS   gpio::B2
+#define SPI_MOSI gpio::B3
+#define SPI_MISO gpio::B4
+#define SPI_SCK  gpio::B5
+
+#elif   ISAVR(ATmega16)     || \
+        ISAVR(ATmega32)     || \
+        ISAVR(ATmega644)    || \
+        ISAVR(ATmega8515)   || \
+        ISAVR(ATmega164P)   || ISAVR(ATmega324P)    || ISAVR(ATmega644P)    || \
+        ISAVR(ATmega164A)   || ISAVR(ATmega164PA)   || ISAVR(ATmega324A)    || ISAVR(ATmega324PA)   || \
+        ISAVR(ATmega644A)   || ISAVR(ATmega644PA)   || ISAVR(ATmega1284)    || ISAVR(ATmega1284P)
+#define SPI_SS   gpio::B4
+#define SPI_MOSI gpio::B5
+#define SPI_MISO gpio::B6
+#define SPI_SCK  gpio::B7
+
+// This fixes improper register/field names in avr-libc for the atmega324pa
+#ifndef SPI2X
+#define SPI2X SPI2X0
+#endif
+#ifndef SPR0
+#define SPR0 SPR00
+#endif
+#ifndef SPR1
+#define SPR1 SPR10
+#endif
+#ifndef SPCR
+#define SPCR SPCR0
+#endif
+#ifndef SPSR
+#define SPSR SPSR0
+#endif
+#ifndef SPE
+#define SPE SPE0
+#endif
+#ifndef MSTR
+#define MSTR MSTR0
+#endif
+#ifndef SPDR
+#define SPDR SPDR0
+#endif
+#ifndef SPIF
+#define SPIF SPIF0
+#endif
+#ifndef SPIE
+#define SPIE SPIE0
+#endif
+#ifndef SPI_STC_vect
+#define SPI_STC_vect SPI0_STC_vect
+#endif
+
+#else
+#warning Unsupported AVR target for SPI interface
+#define SAVR_NO_SPI
+#endif
+
+#endif /* _savr_spi_regs_h_included_ */
@@ -0,0 +1,258 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file task.cpp
+ *
+ * Cooperative task scheduler
+ */
+
+#include <util/atomic.h>
+
+#include <savr/task.h>
+#include <savr/clock.h>
+
+#ifndef CLOCK_NO_TIMERS
+
+using namespace savr;
+
+namespace {
+
+/// Tasks ready to run, oldest first
+task::Task *_ready_head;
+task::Task **_ready_tail = &_ready_head;
+
+/// Delayed tasks, soonest first
+task::Task *_delayed;
+
+/// Number of tasks on the ready list
+volatile uint8_t _ready_count;
+
+/// The running task
+task::Task *_current;
+
+void release_delayed(void *);
+
+/// Moves due tasks from the delayed list to the ready list
+clock::Timer _release_timer(release_delayed, nullptr, clock::TIMER_IN_ISR);
+
+
+/**
+ * Append to the ready list. Interrupts must be disabled.
+ */
+void
+ready_push(task::Task &task) {
+    task.next = nullptr;
+    *_ready_tail = &task;
+    _ready_tail = &task.next;
+    task.state = task::TASK_READY;
+    _ready_count++;
+}
+
+
+/**
+ * Unlink from whichever list the task is on. Interrupts must be disabled.
+ */
+void
+unlink(task::Task &task) {
+    task::Task **link;
+    if (task.state == task::TASK_READY) {
+        link = &_ready_head;
+        _ready_count--;
+    } else if (task.state == task::TASK_DELAYED) {
+        link = &_delayed;
+    } else {
+        return;
+    }
+
+    while (*link != &task) {
+        link = &(*link)->next;
+    }
+    *link = task.next;
+
+    if (_ready_tail == &task.next) {
+        _ready_tail = link;
+    }
+    task.next = nullptr;
+    task.state = task::TASK_IDLE;
+}
+
+
+/**
+ * Arm the release timer for the head of the delayed list. Interrupts must be
+ * disabled.
+ */
+void
+arm_release(uint32_t now) {
+    if (_delayed == nullptr) {
+        clock::stop_timer(_release_timer);
+        return;
+    }
+
+    int32_t left = static_cast<int32_t>(_delayed->wake_tick - now);
+    clock::start_timer(_release_timer, left > 0 ? left : 1);
+}
+
+
+/**
+ * Release timer callback, from the tick ISR
+ */
+void
+release_delayed(void *) {
+    uint32_t now = clock::ticks();
+
+    while (_delayed &&
+           static_cast<int32_t>(now - _delayed->wake_tick) >= 0) {
+        task::Task *task = _delayed;
+        _delayed = task->next;
+        ready_push(*task);
+    }
+    arm_release(now);
+}
+
+}
+
+
+void
+task::wake(Task &task) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (task.state != TASK_READY) {
+            bool was_head = (_delayed == &task);
+            unlink(task);
+            ready_push(task);
+
+            if (was_head) {
+                arm_release(clock::ticks());
+            }
+        }
+    }
+}
+
+
+/**
+ * Delay a task
+ *
+ * @par Implementation Notes:
+ * The delayed list is kept sorted, so insertion walks it, but the release
+ * timer only ever looks at its head.
+ */
+void
+task::sleep(Task &task, uint32_t delay) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        unlink(task);
+
+        uint32_t now = clock::ticks();
+        task.wake_tick = now + delay;
+
+        Task **link = &_delayed;
+        while (*link && static_cast<int32_t>(
+                    (*link)->wake_tick - task.wake_tick) <= 0) {
+            link = &(*link)->next;
+        }
+        task.next = *link;
+        *link = &task;
+        task.state = TASK_DELAYED;
+
+        if (_delayed == &task) {
+            arm_release(now);
+        }
+    }
+}
+
+
+void
+task::cancel(Task &task) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        bool was_head = (task.state == TASK_DELAYED && _delayed == &task);
+        unlink(task);
+        if (was_head) {
+            arm_release(clock::ticks());
+        }
+    }
+}
+
+
+task::Task *
+task::current() {
+    return _current;
+}
+
+
+bool
+task::run_once() {
+    clock::run_timers();
+
+    Task *task;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        task = _ready_head;
+        if (task) {
+            unlink(*task);
+        }
+    }
+
+    if (task == nullptr) {
+        return false;
+    }
+
+    _current = task;
+    task->func(task->arg);
+    _current = nullptr;
+    return true;
+}
+
+
+/**
+ * Check for ready tasks. Called by clock::idle() with interrupts disabled.
+ */
+static bool
+tasks_ready() {
+    return _ready_count != 0;
+}
+
+
+/**
+ * @par Implementation Notes:
+ * A pass runs at most the tasks that were ready when it started, so a task
+ * that yields can't starve the poll function. Deferred timers are run on
+ * every pass, ready tasks or not: clock::idle() won't sleep while one is
+ * waiting. The ready check before sleeping is made by clock::idle() with
+ * interrupts disabled, so a wake() from an ISR can't be missed.
+ */
+void
+task::run(void (*poll)()) {
+    for (;;) {
+        clock::run_timers();
+
+        for (uint8_t count = _ready_count; count; --count) {
+            if (!run_once()) {
+                break;
+            }
+        }
+
+        if (poll) {
+            poll();
+        }
+
+        clock::idle(tasks_ready);
+    }
+}
+
+#endif
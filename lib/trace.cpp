@@ -0,0 +1,144 @@
+/*******************************************************************************
+ Copyright (C) 2026 by Stefan Filipek
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*******************************************************************************/
+/**
+ * @file trace.cpp
+ *
+ * Binary event trace ring
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <util/atomic.h>
+
+#include <savr/clock.h>
+#include <savr/cpp_pgmspace.h>
+#include <savr/trace.h>
+
+using namespace savr;
+
+#ifdef SAVR_TRACE_ENABLE
+
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 32
+#endif
+
+static_assert(TRACE_RECORDS > 0 && TRACE_RECORDS <= 128 &&
+              (TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0,
+              "TRACE_RECORDS must be a power of two up to 128");
+
+namespace {
+
+constexpr uint8_t MASK = TRACE_RECORDS - 1;
+
+trace::Record _ring[TRACE_RECORDS];
+uint8_t _head;          ///< Next record to write
+uint8_t _count;         ///< Records held
+uint16_t _lost;         ///< Records overwritten since the last clear
+volatile bool _paused;  ///< Set while command() prints
+
+}
+
+
+/**
+ * @par Implementation Notes:
+ * The tick is read inside the locked section, so clock::ticks_word() can
+ * skip its own locking.
+ */
+void
+trace::record(uint8_t event, uint16_t arg) {
+    if (_paused) return;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        Record &r = _ring[_head];
+        r.tick = clock::ticks_word();
+        r.event = event;
+        r.arg = arg;
+
+        _head = (_head + 1) & MASK;
+        if (_count < TRACE_RECORDS) {
+            _count++;
+        } else if (_lost != UINT16_MAX) {
+            _lost++;
+        }
+    }
+}
+
+
+/**
+ * @par Implementation Notes:
+ */
+void
+trace::clear() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        _head = 0;
+        _count = 0;
+        _lost = 0;
+    }
+}
+
+
+/**
+ * @par Implementation Notes:
+ * Nothing writes the ring while it is paused, so it can be read without
+ * locking. Events in that window are not recorded.
+ */
+uint8_t
+trace::command(char *args) {
+    _paused = true;
+
+    uint8_t count = _count;
+    uint8_t index = (_head - count) & MASK;
+
+    printf_P(PSTR("@trace %u %u\n"), count, _lost);
+    for (uint8_t i = 0; i < count; ++i) {
+        const Record &r = _ring[index];
+        printf_P(PSTR("%04x%02x%04x"), r.tick, r.event, r.arg);
+        putchar((i % 6 == 5 || i == count - 1) ? '\n' : ' ');
+        index = (index + 1) & MASK;
+    }
+    puts_P(PSTR("@end"));
+
+    if (strcmp_P(args, PSTR("reset")) == 0) {
+        clear();
+    }
+
+    _paused = false;
+    return 0;
+}
+
+#else
+
+void
+trace::record(uint8_t, uint16_t) {}
+
+
+void
+trace::clear() {}
+
+
+uint8_t
+trace::command(char *) {
+    puts_P(PSTR("Tracing is off (build with -DSAVR_TRACE_ENABLE)"));
+    return 0;
+}
+
+#endif
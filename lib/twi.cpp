@@ -30,6 +30,7 @@
 #include <savr/cpp_pgmspace.h>
 #include <savr/twi.h>
 #include <savr/gpio.h>
+#include <savr/trace.h>
 
 using namespace savr;
 
@@ -225,6 +226,7 @@ twi::address(uint8_t address, bool read) {
     twi::wait();
     state = twi::state();
     if (state != TW_START && state != TW_REP_START) {
+        SAVR_TRACE(trace::EV_TWI_ADDRESS, (address << 8) | state);
         return 1;
     }
 
@@ -232,6 +234,7 @@ twi::address(uint8_t address, bool read) {
     twi::send((address << 1) | ((uint8_t) read));
 
     state = twi::state();
+    SAVR_TRACE(trace::EV_TWI_ADDRESS, (address << 8) | state);
     if (state != TW_MR_SLA_ACK && state != TW_MT_SLA_ACK) {
         return 1;
     }
@@ -245,6 +248,7 @@ twi::address(uint8_t address, bool read) {
  */
 void
 twi::stop() {
+    SAVR_TRACE(trace::EV_TWI_STOP, 0);
     TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
 }
 
@@ -266,4 +270,86 @@ twi::state() {
     return (TWSR & TW_STATUS_MASK);
 }
 
+
+/**
+ * Wait for the bus, giving up after PT_TIMEOUT_MS. Internal to the _pt
+ * functions below, which hold result non-zero until they succeed. A
+ * failure still ends the protothread, with PT_FINISH.
+ */
+#define TWI_PT_WAIT(self)                                                   \
+    do {                                                                    \
+        PT_WAIT_UNTIL_TIMEOUT(self, twi::ready(), twi::PT_TIMEOUT_MS);      \
+        if (PT_TIMED_OUT(self)) {                                           \
+            SAVR_TRACE(trace::EV_TWI_TIMEOUT, twi::state());                \
+            PT_FINISH(self);                                                \
+        }                                                                   \
+    } while (0)
+
+
+/**
+ * @par Implementation notes:
+ */
+pt::State
+twi::address_pt(pt::Pt *self, uint8_t address, bool read, uint8_t &result) {
+    PT_BEGIN(self);
+
+    // Create start condition
+    result = 1;
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);
+    TWI_PT_WAIT(self);
+
+    if (state() != TW_START && state() != TW_REP_START) {
+        PT_FINISH(self);
+    }
+
+    // Send address | RW
+    TWDR = (address << 1) | ((uint8_t) read);
+    TWCR = _BV(TWINT) | _BV(TWEN);
+    TWI_PT_WAIT(self);
+
+    SAVR_TRACE(trace::EV_TWI_ADDRESS, (address << 8) | state());
+    if (state() != TW_MR_SLA_ACK && state() != TW_MT_SLA_ACK) {
+        PT_FINISH(self);
+    }
+
+    result = 0;
+    PT_END(self);
+}
+
+
+/**
+ * @par Implementation notes:
+ */
+pt::State
+twi::send_pt(pt::Pt *self, uint8_t b, uint8_t &result) {
+    PT_BEGIN(self);
+
+    result = 1;
+    TWI_PT_WAIT(self);
+    TWDR = b;
+    TWCR = _BV(TWINT) | _BV(TWEN);
+    TWI_PT_WAIT(self);
+
+    result = 0;
+    PT_END(self);
+}
+
+
+/**
+ * @par Implementation notes:
+ */
+pt::State
+twi::get_pt(pt::Pt *self, bool ack, uint8_t &data, uint8_t &result) {
+    PT_BEGIN(self);
+
+    result = 1;
+    TWI_PT_WAIT(self);
+    TWCR = _BV(TWINT) | _BV(TWEN) | (ack ? _BV(TWEA) : 0);
+    TWI_PT_WAIT(self);
+
+    data = TWDR;
+    result = 0;
+    PT_END(self);
+}
+
 #endif
@@ -28,6 +28,8 @@
 
 #include <savr/w1.h>
 #include <savr/optimized.h>
+#include <savr/prof.h>
+#include <savr/trace.h>
 
 using namespace savr;
 
@@ -90,6 +92,7 @@ W1::reset() {
         presence = (_read_state() == 0);
     }
     DELAY(J);
+    SAVR_TRACE(trace::EV_W1_RESET, presence);
     return presence;
 }
 
@@ -270,6 +273,7 @@ W1::write_bit(bool bit) {
  */
 uint8_t
 W1::read_byte(void) {
+    SAVR_PROFILE("W1::read_byte");
     uint8_t byte = 0;
     for (uint8_t i = 0; i < 8; ++i) {
         byte >>= 1;
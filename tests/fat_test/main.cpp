@@ -0,0 +1,248 @@
+/*************************************************************//**
+ * @file main.c
+ *
+ * @author Stefan Filipek
+ ******************************************************************/
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <savr/version.h>
+#include <savr/cpp_pgmspace.h>
+#include <savr/clock.h>
+#include <savr/fat.h>
+#include <savr/gpio.h>
+#include <savr/sci.h>
+#include <savr/sd.h>
+#include <savr/spi.h>
+#include <savr/terminal.h>
+#include <savr/utils.h>
+
+#define enable_interrupts() sei()
+
+/**
+ * FAT filesystem test
+ *
+ * Files on a FAT16/FAT32 formatted SD card, on the SPI bus with SS on B0.
+ * "mount" brings up the card and the volume, "cat" and "append" read and
+ * write files, and "bench" times sequential appends and reads of a file in
+ * small records, the way a data logger would write it.
+ */
+
+// Terminal display
+#define welcome_message PSTR("\n\nFAT Test for the " SAVR_TARGET_STR ", SAVR " SAVR_VERSION_STR "\n")
+#define prompt_string   PSTR("] ")
+
+using namespace savr;
+
+static uint8_t mount(char*);
+static uint8_t cat(char*);
+static uint8_t append(char*);
+static uint8_t bench(char*);
+
+// Command list
+static cmd::CommandList cmd_list = {
+    {"mount", mount, "Init the card and mount the volume"},
+    {"cat", cat, "Print a file (cat path)"},
+    {"append", append, "Append a line to a file (append path text)"},
+    {"bench", bench, "Time sequential append and read (bench path [KiB])"},
+};
+
+static const gpio::Pin SD_SS = gpio::B0;
+
+// Record size for the benchmark
+static const uint8_t RECORD = 32;
+
+
+/**
+ * Main
+ */
+int
+main(void) {
+    // Setup UART
+    sci::init(250000uL);  // bps
+
+    // Setup the SPI interface
+    spi::init(F_CPU/2);
+
+    // Timing for the benchmark
+    clock::init();
+
+    // Enable interrupts for all services
+    enable_interrupts();
+
+    // Init UART terminal
+    term::init(welcome_message, prompt_string,
+               cmd_list, utils::array_size(cmd_list));
+
+    // Run the terminal
+    term::run();
+
+    /* NOTREACHED */
+    return 0;
+}
+
+
+/**
+ * Prints a failed result
+ */
+static uint8_t
+failed(fat::Result res) {
+    printf_P(PSTR("Error %u\n"), res);
+    return 0;
+}
+
+
+/**
+ * Init the SD card and mount its volume
+ */
+static uint8_t
+mount(char *args) {
+    fat::Result res;
+
+    if (!sd::init(SD_SS)) {
+        return 0;
+    }
+
+    res = fat::mount();
+    if (res) {
+        return failed(res);
+    }
+    printf_P(PSTR("Mounted\n"));
+    return 1;
+}
+
+
+/**
+ * Print a file
+ */
+static uint8_t
+cat(char *args) {
+    fat::File file;
+    fat::Result res;
+    char buf[32];
+    size_t done;
+
+    res = fat::open(file, args, fat::READ);
+    if (res) {
+        return failed(res);
+    }
+
+    do {
+        res = fat::read(file, buf, sizeof(buf), done);
+        fwrite(buf, 1, done, stdout);
+    } while (!res && done);
+
+    fat::close(file);
+    return res ? failed(res) : 1;
+}
+
+
+/**
+ * Append a line to a file, creating it if needed
+ */
+static uint8_t
+append(char *args) {
+    fat::File file;
+    fat::Result res;
+    char *text;
+    size_t done;
+
+    text = strchr(args, ' ');
+    if (!text) {
+        return 0;
+    }
+    *text++ = '\0';
+
+    res = fat::open(file, args, fat::WRITE | fat::CREATE | fat::APPEND);
+    if (!res) {
+        res = fat::write(file, text, strlen(text), done);
+    }
+    if (!res) {
+        res = fat::write(file, "\n", 1, done);
+    }
+    if (!res) {
+        res = fat::close(file);
+    }
+    return res ? failed(res) : 1;
+}
+
+
+/**
+ * Prints a benchmark result as time, throughput and card traffic
+ */
+static void
+report(PGM_P name, uint32_t bytes, uint32_t ms) {
+    sd::CacheStats stats = sd::cache_stats(true);
+    uint32_t kib_s = ms ? (bytes * 1000 / 1024 / ms) : 0;
+
+    printf_P(PSTR("%-7S %6lu ms %4lu KiB/s, %u blocks read %u written\n"),
+             name, ms, kib_s, stats.misses, stats.writebacks);
+}
+
+
+/**
+ * Time appending to a file in records, then reading it back
+ *
+ * @param args the path, and optionally the KiB to write (default 64)
+ */
+static uint8_t
+bench(char *args) {
+    fat::File file;
+    fat::Result res;
+    char *token;
+    char *path;
+    char *current_arg;
+    uint8_t record[RECORD];
+    uint32_t bytes = 64 * 1024uL;
+    uint32_t total;
+    uint32_t start;
+    size_t done;
+
+    path = strtok_r(args, " ", &token);
+    current_arg = strtok_r(NULL, " ", &token);
+    if (current_arg) {
+        bytes = strtoul(current_arg, (char**) NULL, 0) * 1024;
+    }
+
+    for (uint8_t i = 0; i < RECORD; i++) {
+        record[i] = 'a' + i % 26;
+    }
+    record[RECORD - 1] = '\n';
+
+    sd::cache_stats(true);
+    start = clock::ticks();
+    res = fat::open(file, path, fat::WRITE | fat::CREATE | fat::APPEND);
+    for (total = 0; !res && total < bytes; total += RECORD) {
+        res = fat::write(file, record, RECORD, done);
+    }
+    if (!res) {
+        res = fat::close(file);
+    }
+    report(PSTR("append"), total, clock::ticks() - start);
+    if (res) {
+        return failed(res);
+    }
+
+    start = clock::ticks();
+    total = 0;
+    res = fat::open(file, path, fat::READ);
+    while (!res) {
+        res = fat::read(file, record, RECORD, done);
+        total += done;
+        if (!done) {
+            break;
+        }
+    }
+    fat::close(file);
+    report(PSTR("read"), total, clock::ticks() - start);
+
+    return res ? failed(res) : 1;
+}
+
+
+EMPTY_INTERRUPT(__vector_default)
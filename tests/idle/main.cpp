@@ -0,0 +1,138 @@
+/*************************************************************//**
+ * @file main.c
+ *
+ * @author Stefan Filipek
+ ******************************************************************/
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/sci.h>
+#include <savr/terminal.h>
+#include <savr/clock.h>
+#include <savr/gpio.h>
+#include <savr/utils.h>
+
+#define enable_interrupts() sei()
+
+using namespace savr;
+
+// High while the CPU is awake; average it with a meter or scope (or trace
+// it in a simulator) for the duty cycle
+static const gpio::Pin AWAKE_PIN = gpio::D7;
+
+static const uint32_t PERIOD_MS = 100;
+
+static uint32_t deadline_us;
+static uint32_t wakeups;
+static uint32_t latency_max;
+static uint32_t latency_total;
+static uint32_t ticks_slept;
+static uint32_t start_ticks;
+
+
+/**
+ * Measure how late the main loop got to a timer
+ */
+static void
+sample(void *)
+{
+    uint32_t now = clock::micros();
+    uint32_t latency = now - deadline_us;
+    deadline_us += PERIOD_MS * clock::US_PER_TICK;
+
+    wakeups++;
+    latency_total += latency;
+    if (latency > latency_max) {
+        latency_max = latency;
+    }
+}
+
+static clock::Timer sample_timer(sample);
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+stats(char* args)
+{
+    uint32_t elapsed = clock::ticks() - start_ticks;
+    printf_P(PSTR("%lu wakeups, latency avg %lu us, max %lu us\n"),
+             wakeups, wakeups ? latency_total / wakeups : 0, latency_max);
+    printf_P(PSTR("%lu of %lu ticks slept without a tick interrupt\n"),
+             ticks_slept, elapsed);
+    return 0;
+}
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+restart(char* args)
+{
+    wakeups = 0;
+    latency_max = 0;
+    latency_total = 0;
+    ticks_slept = 0;
+    start_ticks = clock::ticks();
+
+    // Latency is measured to the tick the timer is due on
+    deadline_us = (start_ticks + PERIOD_MS) * clock::US_PER_TICK;
+    clock::start_timer(sample_timer, PERIOD_MS, PERIOD_MS);
+    return 0;
+}
+
+
+// Command list
+static cmd::CommandList cmd_list = {
+    {"stats", stats, "Wake-to-run latency and ticks slept"},
+    {"restart", restart, "Clear the stats and restart the timer"},
+};
+
+
+// Terminal display
+#define welcome_message PSTR("Tickless idle test\n")
+#define prompt_string   PSTR("] ")
+
+
+/**
+ * Main
+ */
+int main(void) {
+
+    sci::init(250000uL);  // bps
+
+    gpio::out<AWAKE_PIN>();
+    gpio::high<AWAKE_PIN>();
+
+    clock::init();
+
+    enable_interrupts();
+
+    term::init(welcome_message, prompt_string,
+               cmd_list, utils::array_size(cmd_list));
+
+    restart(nullptr);
+
+    while(true) {
+        clock::run_timers();
+        term::work();
+
+        gpio::low<AWAKE_PIN>();
+        ticks_slept += clock::idle();
+        gpio::high<AWAKE_PIN>();
+    }
+
+    /* NOTREACHED */
+    return 0;
+}
+
+
+EMPTY_INTERRUPT(__vector_default)
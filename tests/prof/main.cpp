@@ -0,0 +1,118 @@
+/*************************************************************//**
+ * @file main.c
+ *
+ * @author Stefan Filipek
+ ******************************************************************/
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/crc.h>
+#include <savr/prof.h>
+#include <savr/sci.h>
+#include <savr/spi.h>
+#include <savr/terminal.h>
+#include <savr/utils.h>
+
+#define enable_interrupts() sei()
+
+/**
+ * Profiling probe demo
+ *
+ * Build the library with DEFS=-DSAVR_PROFILE_ENABLE, run "spi" or "crc" a
+ * few times, then "prof" to see the probes in spi::trx_byte and
+ * crc::crc_16.
+ */
+
+using namespace savr;
+
+static uint8_t buffer[64];
+
+
+/**
+ * Number of runs from the command argument, default 100
+ */
+static uint16_t
+runs(char *args) {
+    uint16_t n = atoi(args);
+    return n ? n : 100;
+}
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+spi_cmd(char* args)
+{
+    uint16_t n = runs(args);
+    spi::ss_low();
+    for (uint16_t i = 0; i < n; ++i) {
+        spi::trx_byte(i);
+    }
+    spi::ss_high();
+    return 0;
+}
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+crc_cmd(char* args)
+{
+    uint16_t n = runs(args);
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < n; ++i) {
+        crc = crc::crc_16(buffer, sizeof(buffer), crc, 0x1021);
+    }
+    printf_P(PSTR("crc %04x\n"), crc);
+    return 0;
+}
+
+
+// Command list
+static cmd::CommandList cmd_list = {
+    {"spi", spi_cmd, "Send [n] SPI bytes"},
+    {"crc", crc_cmd, "CRC a 64 byte buffer [n] times"},
+    {"prof", prof::command, "Print and clear the probe table"},
+};
+
+
+// Terminal display
+#define welcome_message PSTR("Profiling probe test\n")
+#define prompt_string   PSTR("] ")
+
+
+/**
+ * Main
+ */
+int main(void) {
+
+    sci::init(250000uL);  // bps
+    spi::init(4000000uL);
+    spi::ss_high();
+    prof::init();
+
+    for (uint8_t i = 0; i < sizeof(buffer); ++i) {
+        buffer[i] = i;
+    }
+
+    enable_interrupts();
+
+    term::init(welcome_message, prompt_string,
+               cmd_list, utils::array_size(cmd_list));
+
+    term::run();
+
+    /* NOTREACHED */
+    return 0;
+}
+
+
+EMPTY_INTERRUPT(__vector_default)
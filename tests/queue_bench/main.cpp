@@ -0,0 +1,197 @@
+/*************************************************************//**
+ * @file main.c
+ *
+ * @author Stefan Filipek
+ ******************************************************************/
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/queue.h>
+#include <savr/sci.h>
+#include <savr/terminal.h>
+#include <savr/utils.h>
+
+#define enable_interrupts() sei()
+
+using namespace savr;
+
+static const uint16_t ITERATIONS = 256;
+
+static Queue<uint8_t, 8> locked_queue;
+static SpscQueue<uint8_t, 8> spsc_queue;
+static Queue<uint8_t, 512> large_queue;
+
+
+/**
+ * Start Timer1 free-running at the CPU clock
+ */
+static void
+timer_start() {
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    TCCR1B = _BV(CS10);
+}
+
+
+/**
+ * Read Timer1 (cycles since timer_start)
+ */
+static uint16_t
+timer_read() {
+    uint16_t ret;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ret = TCNT1;
+    }
+    return ret;
+}
+
+
+/**
+ * Time a single enq and deq, returning the worst case
+ */
+template<typename Q>
+static void
+time_queue(Q &queue, uint16_t &enq_max, uint16_t &deq_max, uint32_t &total) {
+    uint8_t value;
+    enq_max = 0;
+    deq_max = 0;
+    total = 0;
+
+    for (uint16_t i = 0; i < ITERATIONS; ++i) {
+        uint16_t start = timer_read();
+        queue.enq(static_cast<uint8_t>(i));
+        uint16_t mid = timer_read();
+        queue.deq(&value);
+        uint16_t end = timer_read();
+
+        uint16_t enq = mid - start;
+        uint16_t deq = end - mid;
+        if (enq > enq_max) enq_max = enq;
+        if (deq > deq_max) deq_max = deq;
+        total += enq + deq;
+    }
+}
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+bench(char* args)
+{
+    uint16_t enq_max;
+    uint16_t deq_max;
+    uint32_t total;
+
+    timer_start();
+
+    // Numbers include the timer_read() overhead, which is the same for both
+    time_queue(locked_queue, enq_max, deq_max, total);
+    printf_P(PSTR("Queue:     %lu cyc/byte, enq max %u, deq max %u (all masked)\n"),
+             total / ITERATIONS, enq_max, deq_max);
+
+    time_queue(spsc_queue, enq_max, deq_max, total);
+    printf_P(PSTR("SpscQueue: %lu cyc/byte, enq max %u, deq max %u (none masked)\n"),
+             total / ITERATIONS, enq_max, deq_max);
+    return 0;
+}
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+bulk_bench(char* args)
+{
+    static const uint8_t LENGTH = 64;
+    uint8_t block[LENGTH];
+    uint8_t value;
+
+    timer_start();
+
+    // One element at a time, one critical section each
+    uint16_t start = timer_read();
+    for (uint8_t i = 0; i < LENGTH; ++i) {
+        large_queue.enq(i);
+    }
+    for (uint8_t i = 0; i < LENGTH; ++i) {
+        large_queue.deq(&value);
+    }
+    uint16_t single = timer_read() - start;
+
+    // Whole block, one critical section per direction
+    start = timer_read();
+    large_queue.enq_n(block, LENGTH);
+    large_queue.deq_n(block, LENGTH);
+    uint16_t bulk = timer_read() - start;
+
+    printf_P(PSTR("Queue<512> enq+deq of %u bytes: %u cyc single, %u cyc bulk\n"),
+             LENGTH, single, bulk);
+    return 0;
+}
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+stdio_bench(char* args)
+{
+    static const uint8_t LENGTH = 64;
+    timer_start();
+
+    // Cost of pushing bytes through stdout while the UART drains the buffer
+    uint16_t start = timer_read();
+    for (uint8_t i = 0; i < LENGTH; ++i) {
+        putchar('.');
+    }
+    uint16_t end = timer_read();
+    putchar('\n');
+
+    printf_P(PSTR("putchar: %u cyc/byte (wire limited)\n"),
+             static_cast<uint16_t>(end - start) / LENGTH);
+    return 0;
+}
+
+
+// Command list
+static cmd::CommandList cmd_list = {
+        {"bench", bench, "Cycles per byte for each queue type"},
+        {"bulk", bulk_bench, "Single vs. block moves on a 512-byte Queue"},
+        {"stdio", stdio_bench, "Cycles per byte through stdout"},
+};
+
+
+// Terminal display
+#define welcome_message PSTR("Queue Benchmark\n")
+#define prompt_string   PSTR("] ")
+
+
+/**
+ * Main
+ */
+int main(void) {
+
+    sci::init(250000uL); // bps
+
+    enable_interrupts();
+
+    term::init(welcome_message, prompt_string,
+               cmd_list, utils::array_size(cmd_list));
+
+    term::run();
+
+    /* NOTREACHED */
+    return 0;
+}
+
+
+EMPTY_INTERRUPT(__vector_default)
@@ -0,0 +1,163 @@
+/*************************************************************//**
+ * @file main.c
+ *
+ * @author Stefan Filipek
+ ******************************************************************/
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/clock.h>
+#include <savr/sci.h>
+#include <savr/terminal.h>
+#include <savr/utils.h>
+
+#define enable_interrupts() sei()
+
+using namespace savr;
+
+#if defined(SAVR_SCI_USART1)
+
+static const uint32_t BAUD = 250000uL;
+static const uint16_t BLOCK_SIZE = 256;
+static const uint8_t BLOCK_COUNT = 16;
+
+static uint8_t block[BLOCK_SIZE];
+
+static volatile uint8_t blocks_left_0;
+static volatile uint8_t blocks_left_1;
+
+
+static void
+next_block_0() {
+    if (blocks_left_0) {
+        blocks_left_0--;
+        sci::Usart<0>::send_async(block, BLOCK_SIZE, next_block_0, false);
+    }
+}
+
+
+static void
+next_block_1() {
+    if (blocks_left_1) {
+        blocks_left_1--;
+        sci::Usart<1>::send_async(block, BLOCK_SIZE, next_block_1, false);
+    }
+}
+
+
+/**
+ * Count main loop iterations for the given number of ticks
+ */
+static uint32_t
+spin(uint32_t duration, uint32_t &rx_bytes) {
+    uint8_t sink[16];
+    uint32_t count = 0;
+    uint32_t start = clock::ticks();
+
+    while ((clock::ticks() - start) < duration) {
+        rx_bytes += sci::Usart<1>::read(sink, sizeof(sink));
+        count++;
+    }
+    return count;
+}
+
+
+/**
+ * Terminal command callbacks
+ *
+ * Streams BLOCK_COUNT blocks out of both USARTs at once and reports the CPU
+ * time left over for the main loop. Loop TXD1 back to RXD1 to also check the
+ * receive path.
+ */
+static uint8_t
+blast(char* args)
+{
+    uint32_t rx_bytes = 0;
+    uint32_t bytes = static_cast<uint32_t>(BLOCK_SIZE) * BLOCK_COUNT;
+    // Wire time for the whole run, 10 bits per byte, plus some slop
+    uint32_t duration = bytes * 10 * clock::TICKS_PER_SEC / BAUD + 10;
+
+    for (uint16_t i = 0; i < BLOCK_SIZE; ++i) {
+        block[i] = 'A' + (i % 26);
+    }
+
+    uint32_t idle = spin(duration, rx_bytes);
+    rx_bytes = 0;
+
+    // The console is USART0, so the blast shows up there as well
+    blocks_left_0 = BLOCK_COUNT;
+    blocks_left_1 = BLOCK_COUNT;
+    uint32_t start = clock::ticks();
+    next_block_0();
+    next_block_1();
+    uint32_t busy = spin(duration, rx_bytes);
+    uint32_t elapsed = clock::ticks() - start;
+
+    while (sci::Usart<0>::async_busy() || sci::Usart<1>::async_busy()) {
+    }
+
+    printf_P(PSTR("\n%lu bytes per port in %lu ms\n"), bytes, elapsed);
+    printf_P(PSTR("Main loop: %lu idle, %lu during (%lu%% CPU left)\n"),
+             idle, busy, busy * 100 / idle);
+    printf_P(PSTR("USART1 loopback: %lu bytes received\n"), rx_bytes);
+    return 0;
+}
+
+
+// Command list
+static cmd::CommandList cmd_list = {
+        {"blast", blast, "Stream out of both USARTs at full rate"},
+        {"sci", sci::stats_command, "USART0 counters, 'sci reset' to clear"},
+};
+
+
+// Terminal display
+#define welcome_message PSTR("Dual USART Test\n")
+#define prompt_string   PSTR("] ")
+
+
+/**
+ * Main
+ */
+int main(void) {
+
+    sci::init(BAUD); // bps
+    sci::Usart<1>::init(BAUD);
+    clock::init();
+
+    enable_interrupts();
+
+    term::init(welcome_message, prompt_string,
+               cmd_list, utils::array_size(cmd_list));
+
+    term::run();
+
+    /* NOTREACHED */
+    return 0;
+}
+
+#else
+
+int main(void) {
+    sci::init(250000uL); // bps
+
+    enable_interrupts();
+
+    printf_P(PSTR("Dual USART Test requires a target with USART1\n"));
+    while (true) {
+    }
+
+    /* NOTREACHED */
+    return 0;
+}
+
+#endif
+
+
+EMPTY_INTERRUPT(__vector_default)
@@ -26,11 +26,13 @@
 #include <savr/version.h>
 #include <savr/cpp_pgmspace.h>
 #include <savr/sci.h>
+#include <savr/clock.h>
 #include <savr/spi.h>
 #include <savr/sd.h>
 #include <savr/terminal.h>
 #include <savr/utils.h>
 #include <savr/gpio.h>
+#include <savr/trace.h>
 
 #define enable_interrupts() sei()
 
@@ -46,6 +48,8 @@ static uint8_t write(char*);
 static uint8_t erase(char*);
 static uint8_t scan(char*);
 static uint8_t sdinit(char*);
+static uint8_t bench(char*);
+static uint8_t rmw(char*);
 static uint8_t help(char*);
 
 // Command list
@@ -56,10 +60,16 @@ static cmd::CommandList cmd_list = {
     {"erase", erase, NULL},
     {"scan", scan, NULL},
     {"sdinit", sdinit, NULL},
+    {"bench", bench, "Time single vs multi-block transfers (bench addr [blocks]). Overwrites the card!"},
+    {"rmw", rmw, "Time read-modify-write with and without the block cache (rmw block [ops])"},
+    {"trace", trace::command, "Dump the event trace (trace reset: and clear it)"},
 };
 
 static const gpio::Pin SD_SS = gpio::B0;
 
+// Shared by the benchmarks
+static uint8_t block[512];
+
 
 /**
  * Main
@@ -72,6 +82,9 @@ main(void) {
     // Setup the SPI interface
     spi::init(F_CPU/2);
 
+    // Timestamps for the event trace
+    clock::init();
+
     // Enable interrupts for all services
     enable_interrupts();
 
@@ -320,5 +333,155 @@ uint8_t sdinit(char * args)
 }
 
 
+/**
+ * Prints a benchmark result as time and throughput.
+ */
+static void
+report(PGM_P name, uint32_t blocks, uint32_t ms)
+{
+    uint32_t kib_s = ms ? (blocks * 500uL / ms) : 0;
+    printf_P(PSTR("%-14S %6lu ms %5lu KiB/s\n"), name, ms, kib_s);
+}
+
+
+/**
+ * Compare single-block and multi-block transfer speed.
+ *
+ * Writes, then reads back, the same run of blocks both one command per
+ * block and as a single stream, timing each with the clock.
+ *
+ * @param args a space seperated string containing the start address
+ * (32bit, block aligned) and optionally the number of blocks (default 16).
+ *
+ * @return 1 if successful, 0 otherwise
+ */
+uint8_t bench(char * args)
+{
+    char * token;
+    char * current_arg;
+
+    uint32_t addr;
+    uint32_t blocks = 16;
+    uint32_t i;
+    uint32_t start;
+    uint8_t ok = 1;
+
+    current_arg = strtok_r(args, " ", &token);
+    addr = strtoul(current_arg, (char**) NULL, 0);
+
+    current_arg = strtok_r(NULL, " ", &token);
+    if (current_arg) {
+        blocks = strtoul(current_arg, (char**) NULL, 0);
+    }
+
+    for (i = 0; i < sizeof(block); i++) {
+        block[i] = (uint8_t) i;
+    }
+
+    printf("addr: %08lX, blocks: %lu\n", addr, blocks);
+
+    start = clock::ticks();
+    for (i = 0; ok && i < blocks; i++) {
+        ok = sd::write_block(addr + i * sizeof(block), block, sizeof(block));
+    }
+    report(PSTR("write single"), blocks, clock::ticks() - start);
+
+    start = clock::ticks();
+    ok = ok && sd::write_begin(addr / sizeof(block), blocks);
+    for (i = 0; ok && i < blocks; i++) {
+        ok = sd::write_next(block);
+    }
+    ok = sd::write_end() && ok;
+    report(PSTR("write multi"), blocks, clock::ticks() - start);
+
+    start = clock::ticks();
+    for (i = 0; ok && i < blocks; i++) {
+        ok = sd::read_block(addr + i * sizeof(block), block, sizeof(block));
+    }
+    report(PSTR("read single"), blocks, clock::ticks() - start);
+
+    start = clock::ticks();
+    ok = ok && sd::read_begin(addr / sizeof(block));
+    for (i = 0; ok && i < blocks; i++) {
+        ok = sd::read_next(block);
+    }
+    ok = sd::read_end() && ok;
+    report(PSTR("read multi"), blocks, clock::ticks() - start);
+
+    if (!ok) {
+        printf("Failed at block %lu\n", i);
+    }
+
+    return ok;
+}
+
+
+/**
+ * Compare read-modify-write with and without the block cache.
+ *
+ * Bumps bytes in two alternating blocks, the way a filesystem updates an
+ * allocation table and a directory entry. Without the cache every update
+ * reads and writes a block; with it, the blocks stay in RAM until flushed.
+ *
+ * @param args a space seperated string containing the first block number
+ * and optionally the number of updates (default 64).
+ *
+ * @return 1 if successful, 0 otherwise
+ */
+uint8_t rmw(char * args)
+{
+    char * token;
+    char * current_arg;
+
+    uint32_t first;
+    uint16_t ops = 64;
+    uint16_t i;
+    uint32_t start;
+    uint8_t *data;
+    uint8_t ok = 1;
+    sd::CacheStats stats;
+
+    current_arg = strtok_r(args, " ", &token);
+    first = strtoul(current_arg, (char**) NULL, 0);
+
+    current_arg = strtok_r(NULL, " ", &token);
+    if (current_arg) {
+        ops = (uint16_t) strtoul(current_arg, (char**) NULL, 0);
+    }
+
+    start = clock::ticks();
+    for (i = 0; ok && i < ops; i++) {
+        ok = sd::read_sector(first + (i & 1), block);
+        block[(i / 2) % sizeof(block)]++;
+        ok = ok && sd::write_sector(first + (i & 1), block);
+    }
+    printf_P(PSTR("uncached %6lu ms %5u card blocks\n"),
+             clock::ticks() - start, 2 * i);
+
+    sd::cache_invalidate();
+    sd::cache_stats(true);
+
+    start = clock::ticks();
+    for (i = 0; ok && i < ops; i++) {
+        data = sd::cache_block(first + (i & 1), true);
+        ok = data != NULL;
+        if (ok) {
+            data[(i / 2) % sizeof(block)]++;
+        }
+    }
+    ok = sd::flush() && ok;
+    stats = sd::cache_stats();
+    printf_P(PSTR("cached   %6lu ms %5u card blocks (%u hits)\n"),
+             clock::ticks() - start, stats.misses + stats.writebacks,
+             stats.hits);
+
+    if (!ok) {
+        printf("Failed at update %u\n", i);
+    }
+
+    return ok;
+}
+
+
 EMPTY_INTERRUPT(__vector_default)
 
@@ -0,0 +1,201 @@
+/*************************************************************//**
+ * @file main.c
+ *
+ * @author Stefan Filipek
+ ******************************************************************/
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <savr/version.h>
+#include <savr/cpp_pgmspace.h>
+#include <savr/clock.h>
+#include <savr/gpio.h>
+#include <savr/sci.h>
+#include <savr/sd.h>
+#include <savr/sdlog.h>
+#include <savr/spi.h>
+#include <savr/terminal.h>
+#include <savr/utils.h>
+
+#define enable_interrupts() sei()
+
+/**
+ * SD record log test
+ *
+ * A log of 16-byte sensor-style records on a range of raw blocks of the SD
+ * card (SS on B0). "mount" times finding the head of the log, "bench" times
+ * appending records, and "dump" prints them back. Whatever was in the range
+ * is overwritten!
+ */
+
+// Terminal display
+#define welcome_message PSTR("\n\nSD Log Test for the " SAVR_TARGET_STR ", SAVR " SAVR_VERSION_STR "\n")
+#define prompt_string   PSTR("] ")
+
+using namespace savr;
+
+static uint8_t mount(char*);
+static uint8_t bench(char*);
+static uint8_t dump(char*);
+static uint8_t clear(char*);
+
+// Command list
+static cmd::CommandList cmd_list = {
+    {"mount", mount, "Init the card and mount the log (mount [first [blocks]])"},
+    {"bench", bench, "Time appending records (bench [count])"},
+    {"dump", dump, "Print every record"},
+    {"clear", clear, "Drop every record"},
+};
+
+static const gpio::Pin SD_SS = gpio::B0;
+
+typedef struct {
+    uint32_t time;
+    uint32_t index;
+    int16_t value[4];
+} Record;
+
+static uint32_t next_index;
+
+
+/**
+ * Main
+ */
+int
+main(void) {
+    // Setup UART
+    sci::init(250000uL);  // bps
+
+    // Setup the SPI interface
+    spi::init(F_CPU/2);
+
+    // Timestamps, and timing for the benchmarks
+    clock::init();
+
+    // Enable interrupts for all services
+    enable_interrupts();
+
+    // Init UART terminal
+    term::init(welcome_message, prompt_string,
+               cmd_list, utils::array_size(cmd_list));
+
+    // Run the terminal
+    term::run();
+
+    /* NOTREACHED */
+    return 0;
+}
+
+
+/**
+ * Init the card and mount the log
+ *
+ * @param args the first block (default 65536) and the number of blocks
+ * (default 1048576, 512 MiB) of the range
+ */
+static uint8_t
+mount(char *args) {
+    char *token;
+    char *current_arg;
+    uint32_t first = 65536;
+    uint32_t blocks = 1048576;
+    uint32_t start;
+
+    current_arg = strtok_r(args, " ", &token);
+    if (current_arg) {
+        first = strtoul(current_arg, (char**) NULL, 0);
+        current_arg = strtok_r(NULL, " ", &token);
+        if (current_arg) {
+            blocks = strtoul(current_arg, (char**) NULL, 0);
+        }
+    }
+
+    if (!sd::init(SD_SS)) {
+        return 0;
+    }
+
+    start = clock::ticks();
+    if (!sdlog::mount(first, blocks, sizeof(Record))) {
+        printf_P(PSTR("Mount failed; clear to start a new log\n"));
+        return 0;
+    }
+    printf_P(PSTR("Mounted in %lu ms, %lu records\n"),
+             clock::ticks() - start, sdlog::count());
+    next_index = sdlog::count();
+    return 1;
+}
+
+
+/**
+ * Time appending records, then a sync
+ *
+ * @param args the number of records (default 1000)
+ */
+static uint8_t
+bench(char *args) {
+    Record record;
+    uint32_t count = 1000;
+    uint32_t start;
+    uint32_t ms;
+    uint32_t i;
+
+    if (*args) {
+        count = strtoul(args, (char**) NULL, 0);
+    }
+
+    start = clock::ticks();
+    for (i = 0; i < count; i++) {
+        record.time = clock::ticks();
+        record.index = next_index++;
+        for (uint8_t v = 0; v < 4; v++) {
+            record.value[v] = (int16_t) (i * (v + 1));
+        }
+        if (!sdlog::append(&record)) {
+            break;
+        }
+    }
+    if (i == count && !sdlog::sync()) {
+        i = 0;
+    }
+    ms = clock::ticks() - start;
+
+    printf_P(PSTR("%lu records in %lu ms, %lu records/s\n"), i, ms,
+             ms ? i * 1000 / ms : 0);
+    return i == count;
+}
+
+
+/**
+ * Print every record, oldest first
+ */
+static uint8_t
+dump(char *args) {
+    sdlog::Reader reader;
+    Record record;
+
+    sdlog::rewind(reader);
+    while (sdlog::read(reader, &record)) {
+        printf_P(PSTR("%lu %lu %d %d %d %d\n"), record.index, record.time,
+                 record.value[0], record.value[1], record.value[2],
+                 record.value[3]);
+    }
+    return 1;
+}
+
+
+/**
+ * Drop every record
+ */
+static uint8_t
+clear(char *args) {
+    next_index = 0;
+    return sdlog::clear(sizeof(Record));
+}
+
+
+EMPTY_INTERRUPT(__vector_default)
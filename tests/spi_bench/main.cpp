@@ -0,0 +1,246 @@
+/*************************************************************//**
+ * @file main.c
+ *
+ * @author Stefan Filipek
+ ******************************************************************/
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/crc.h>
+#include <savr/mspim.h>
+#include <savr/sci.h>
+#include <savr/spi.h>
+#include <savr/terminal.h>
+#include <savr/utils.h>
+
+#define enable_interrupts() sei()
+
+/**
+ * SPI blocking vs. async benchmark
+ *
+ * For each SPI clock, a 512 byte sector is sent with spi::write_block(),
+ * then with spi::transfer_async() while the main loop CRCs another buffer
+ * a byte at a time. The CRC rate during the transfer, against its rate
+ * with the CPU to itself, is the CPU time left over. Nothing needs to be
+ * connected to the SPI pins.
+ *
+ * "kernels" compares the fck/2 block kernels against a plain trx_byte()
+ * loop. On parts with a second USART, "mspim" times the same sector on
+ * USART1 as an SPI master (SCK on XCK1).
+ */
+
+using namespace savr;
+
+static const uint16_t SECTOR = 512;
+
+// Timer1 counts at F_CPU / 8, so a sector at fck/64 still fits in 16 bits
+static const uint8_t CYCLES_PER_COUNT = 8;
+
+static uint8_t sector[SECTOR];
+static uint8_t other[SECTOR];
+
+
+/**
+ * Start Timer1 free-running at F_CPU / 8
+ */
+static void
+timer_start() {
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    TCCR1B = _BV(CS11);
+}
+
+
+/**
+ * Read Timer1, in CPU cycles since timer_start
+ */
+static uint32_t
+timer_read() {
+    uint16_t ret;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ret = TCNT1;
+    }
+    return static_cast<uint32_t>(ret) * CYCLES_PER_COUNT;
+}
+
+
+/**
+ * CRC one byte; the unit of "work" done alongside a transfer
+ */
+static uint16_t
+work(uint16_t crc, uint16_t i) {
+    return crc::crc_16(&other[i % SECTOR], 1, crc, 0x1021);
+}
+
+
+/**
+ * Cycles per byte of work, times 100, with nothing else running
+ */
+static uint32_t
+work_cost() {
+    uint16_t crc = 0xFFFF;
+    timer_start();
+    for (uint16_t i = 0; i < SECTOR; ++i) {
+        crc = work(crc, i);
+    }
+    uint32_t cycles = timer_read();
+    return cycles * 100 / SECTOR;
+}
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+bench(char* args)
+{
+    uint32_t cost = work_cost();
+    printf_P(PSTR("CRC alone: %lu.%02lu cycles/byte\n"), cost / 100, cost % 100);
+    printf_P(PSTR("%6s %10s %10s %8s\n"), "clock", "blocking", "async", "free");
+
+    for (uint8_t div = 2; div <= 64; div *= 2) {
+        spi::init(F_CPU / div);
+
+        spi::ss_low();
+        timer_start();
+        spi::write_block(sector, SECTOR);
+        uint32_t blocking = timer_read();
+
+        uint16_t crc = 0xFFFF;
+        uint16_t done = 0;
+        timer_start();
+        spi::transfer_async(sector, nullptr, SECTOR);
+        while (spi::busy()) {
+            crc = work(crc, done++);
+        }
+        uint32_t async = timer_read();
+        spi::ss_high();
+
+        // Work done during the transfer, against what an idle CPU would do
+        uint32_t free = done * cost / async;
+        printf_P(PSTR("  /%-3u %10lu %10lu %7lu%%\n"), div, blocking, async, free);
+    }
+    return 0;
+}
+
+
+/**
+ * Print a sector time as cycles per byte and KiB/s
+ */
+static void
+report(PGM_P name, uint32_t cycles)
+{
+    printf_P(PSTR("%-12S %6lu cycles  %lu.%02lu cycles/byte  %lu KiB/s\n"),
+             name, cycles, cycles / SECTOR, (cycles % SECTOR) * 100 / SECTOR,
+             F_CPU / 1024 * SECTOR / cycles);
+}
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+kernels(char* args)
+{
+    spi::init(F_CPU / 2);
+    spi::ss_low();
+
+    timer_start();
+    for (uint16_t i = 0; i < SECTOR; ++i) {
+        spi::trx_byte(sector[i]);
+    }
+    report(PSTR("trx_byte"), timer_read());
+
+    timer_start();
+    spi::write_block(sector, SECTOR);
+    report(PSTR("write_block"), timer_read());
+
+    timer_start();
+    spi::read_block(other, SECTOR, 0xFF);
+    report(PSTR("read_block"), timer_read());
+
+    timer_start();
+    spi::trx_block(sector, other, SECTOR);
+    report(PSTR("trx_block"), timer_read());
+
+    spi::ss_high();
+    return 0;
+}
+
+
+#if defined(UMSEL01) && defined(UDR1)
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+mspim_cmd(char* args)
+{
+    typedef mspim::Bus<1> Bus;
+    Bus::init(F_CPU / 2);
+
+    timer_start();
+    Bus::write_block(sector, SECTOR);
+    report(PSTR("write_block"), timer_read());
+
+    timer_start();
+    Bus::read_block(other, SECTOR, 0xFF);
+    report(PSTR("read_block"), timer_read());
+
+    timer_start();
+    Bus::trx_block(sector, other, SECTOR);
+    report(PSTR("trx_block"), timer_read());
+    return 0;
+}
+#endif
+
+
+// Command list
+static cmd::CommandList cmd_list = {
+    {"bench", bench, "Time a 512 byte sector, blocking and async, at each SPI clock"},
+    {"kernels", kernels, "Time the fck/2 block kernels against a trx_byte loop"},
+#if defined(UMSEL01) && defined(UDR1)
+    {"mspim", mspim_cmd, "Time a 512 byte sector on USART1 in SPI master mode"},
+#endif
+};
+
+
+// Terminal display
+#define welcome_message PSTR("SPI benchmark\n")
+#define prompt_string   PSTR("] ")
+
+
+/**
+ * Main
+ */
+int main(void) {
+
+    sci::init(250000uL);  // bps
+    spi::init(F_CPU / 2);
+    spi::ss_high();
+
+    for (uint16_t i = 0; i < SECTOR; ++i) {
+        sector[i] = i;
+        other[i] = ~i;
+    }
+
+    enable_interrupts();
+
+    term::init(welcome_message, prompt_string,
+               cmd_list, utils::array_size(cmd_list));
+
+    term::run();
+
+    /* NOTREACHED */
+    return 0;
+}
+
+
+EMPTY_INTERRUPT(__vector_default)
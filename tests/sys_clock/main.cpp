@@ -66,9 +66,67 @@ tock_byte(char* args)
     }
 }
 
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+micros(char* args)
+{
+    // Time a known delay with both sub-millisecond clocks
+    uint32_t start_us = clock::micros();
+    uint32_t start_cyc = clock::cycles();
+    _delay_us(500);
+    uint32_t end_cyc = clock::cycles();
+    uint32_t end_us = clock::micros();
+
+    printf_P(PSTR("now %lu us; 500us delay took %lu us, %lu cycles\n"),
+             end_us, end_us - start_us, end_cyc - start_cyc);
+    return 0;
+}
+
+/**
+ * Pulse the LED from the tick ISR
+ */
+static void
+blink(void *)
+{
+    gpio::toggle<gpio::D7>();
+}
+
+static clock::Timer blink_timer(blink, nullptr, clock::TIMER_IN_ISR);
+
+
+/**
+ * Report a one-shot timer from the main loop
+ */
+static void
+report(void *arg)
+{
+    printf_P(PSTR("Timer fired at %lu (armed at %lu)\n"), clock::ticks(),
+             *static_cast<uint32_t *>(arg));
+}
+
+static uint32_t armed_at;
+static clock::Timer report_timer(report, &armed_at);
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+after(char* args)
+{
+    uint32_t delay = strtoul(args, NULL, 0);
+    armed_at = clock::ticks();
+    clock::start_timer(report_timer, delay);
+    return 0;
+}
+
 // Command list
 static cmd::CommandList cmd_list = {
+    {"after", after, "Prints the ticks after the given delay, via a timer"},
     {"tick", tick, "Prints the number of ticks elapsed"},
+    {"micros", micros, "Times a 500us delay with micros() and cycles()"},
     {"tock", tock, "Continually prints the number of ticks elapsed"},
     {"tick-byte", tick_byte, "Prints the lowest byte of the number of ticks elapsed"},
     {"tock-byte", tock_byte, "Continually prints the lowest byte of number of ticks elapsed"},
@@ -97,16 +155,11 @@ int main(void) {
     gpio::low<gpio::D7>();
 
     clock::init();
-
-    uint32_t last_tick = 0;
+    clock::start_timer(blink_timer, clock::TICKS_PER_SEC,
+                       clock::TICKS_PER_SEC);
 
     while(true) {
-        uint32_t now = clock::ticks();
-        if((now - last_tick) > clock::TICKS_PER_SEC) {
-            last_tick = now;
-            gpio::toggle<gpio::D7>();
-        }
-
+        clock::run_timers();
         term::work();
     }
 
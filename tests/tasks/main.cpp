@@ -0,0 +1,142 @@
+/*************************************************************//**
+ * @file main.c
+ *
+ * @author Stefan Filipek
+ ******************************************************************/
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <savr/cpp_pgmspace.h>
+#include <savr/sci.h>
+#include <savr/terminal.h>
+#include <savr/clock.h>
+#include <savr/task.h>
+#include <savr/gpio.h>
+#include <savr/utils.h>
+
+#define enable_interrupts() sei()
+
+using namespace savr;
+
+static const gpio::Pin LED_PIN = gpio::D7;
+static const gpio::Pin BUTTON_PIN = gpio::D2;   // INT0
+
+static uint16_t presses;
+static uint16_t blinks;
+static uint16_t seconds;
+static uint32_t press_latency_max;
+static volatile uint32_t press_time;
+
+
+/**
+ * Periodic task: toggle the LED
+ */
+static void
+blink(void *)
+{
+    gpio::toggle<LED_PIN>();
+    blinks++;
+    task::sleep(*task::current(), 500);
+}
+
+static task::Task blink_task(blink);
+
+
+/**
+ * Event task: woken by the button ISR
+ */
+static void
+button(void *)
+{
+    uint32_t latency = clock::micros() - press_time;
+    if (latency > press_latency_max) {
+        press_latency_max = latency;
+    }
+    presses++;
+}
+
+static task::Task button_task(button);
+
+
+/**
+ * Deferred timer: run by task::run() from the main loop, mostly while
+ * every task is delayed
+ */
+static void
+second(void *)
+{
+    seconds++;
+}
+
+static clock::Timer second_timer(second);
+
+
+/**
+ * Button press, falling edge on INT0
+ */
+ISR(INT0_vect)
+{
+    press_time = clock::micros();
+    task::wake(button_task);
+}
+
+
+/**
+ * Terminal command callbacks
+ */
+static uint8_t
+stats(char* args)
+{
+    printf_P(PSTR("%u blinks, %u presses, %u s, ISR-to-task max %lu us\n"),
+             blinks, presses, seconds, press_latency_max);
+    return 0;
+}
+
+
+// Command list
+static cmd::CommandList cmd_list = {
+    {"stats", stats, "Task run counts and wake latency"},
+};
+
+
+// Terminal display
+#define welcome_message PSTR("Task scheduler test\n")
+#define prompt_string   PSTR("] ")
+
+
+/**
+ * Main
+ */
+int main(void) {
+
+    sci::init(250000uL);  // bps
+
+    gpio::out<LED_PIN>();
+    gpio::in<BUTTON_PIN>();
+    gpio::high<BUTTON_PIN>();   // Pull-up
+
+    EICRA = _BV(ISC01);         // Falling edge
+    EIMSK = _BV(INT0);
+
+    clock::init();
+
+    enable_interrupts();
+
+    term::init(welcome_message, prompt_string,
+               cmd_list, utils::array_size(cmd_list));
+
+    clock::start_timer(second_timer, clock::TICKS_PER_SEC, clock::TICKS_PER_SEC);
+    task::wake(blink_task);
+    task::run(term::work);
+
+    /* NOTREACHED */
+    return 0;
+}
+
+
+EMPTY_INTERRUPT(__vector_default)
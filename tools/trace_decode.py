@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""
+Decode a SAVR event trace dump.
+
+Capture the output of the "trace" terminal command (savr::trace::command)
+and pass it on stdin or as a file. Event names are read from trace.h, so
+they always match the library the dump came from.
+
+    python3 tools/trace_decode.py capture.txt
+    python3 tools/trace_decode.py --header path/to/trace.h < capture.txt
+
+Copyright (C) 2026 by Stefan Filipek. MIT license, see LICENSE.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+DEFAULT_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              '..', 'include', 'savr', 'trace.h')
+
+EVENT_RE = re.compile(r'^\s*(EV_\w+)\s*=\s*(0x[0-9a-fA-F]+|\d+)\s*,', re.M)
+RECORD_RE = re.compile(r'^[0-9a-fA-F]{10}$')
+
+
+def load_events(path):
+    """Map event ID to name from the Event enum in trace.h"""
+    with open(path) as f:
+        text = f.read()
+    return {int(value, 0): name for name, value in EVENT_RE.findall(text)}
+
+
+def event_name(events, event_id):
+    if event_id in events:
+        return events[event_id]
+    user = [k for k, v in events.items() if v == 'EV_USER']
+    if user and event_id > user[0]:
+        return 'EV_USER+%d' % (event_id - user[0])
+    return 'EV_0x%02x' % event_id
+
+
+def dumps(lines):
+    """Yield (count, lost, [(tick, event, arg)]) for each dump in the input"""
+    records = None
+    header = None
+    for line in lines:
+        line = line.strip()
+        if line.startswith('@trace'):
+            fields = line.split()
+            header = (int(fields[1]), int(fields[2]))
+            records = []
+        elif line.startswith('@end') and records is not None:
+            yield header[0], header[1], records
+            records = None
+        elif records is not None:
+            for word in line.split():
+                if not RECORD_RE.match(word):
+                    raise ValueError('bad record: %r' % word)
+                records.append((int(word[0:4], 16),
+                                int(word[4:6], 16),
+                                int(word[6:10], 16)))
+
+
+def decode(lines, events, out):
+    for n, (count, lost, records) in enumerate(dumps(lines)):
+        if n:
+            out.write('\n')
+        out.write('%d records' % count)
+        if lost:
+            out.write(', %d older records overwritten' % lost)
+        out.write('\n')
+        if len(records) != count:
+            out.write('warning: expected %d records, got %d\n'
+                      % (count, len(records)))
+
+        # Ticks are the low 16 bits of the millisecond clock. Unwrap them,
+        # assuming no gap between records is longer than 65 seconds.
+        elapsed = 0
+        last = records[0][0] if records else 0
+        for tick, event_id, arg in records:
+            elapsed += (tick - last) & 0xFFFF
+            last = tick
+            out.write('%10d ms  %-20s 0x%04x  %5d\n'
+                      % (elapsed, event_name(events, event_id), arg, arg))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument('input', nargs='?', help='captured dump (default: stdin)')
+    parser.add_argument('--header', default=DEFAULT_HEADER,
+                        help='trace.h to read event names from')
+    args = parser.parse_args()
+
+    events = load_events(args.header)
+    if args.input:
+        with open(args.input) as f:
+            decode(f, events, sys.stdout)
+    else:
+        decode(sys.stdin, events, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()